@@ -34,6 +34,16 @@
 #include "iotools.h"
 #include "common.h"
 
+#if HAVE_CLOCK_GETTIME
+#include <time.h>
+#endif
+
+#if HAVE_NMMINTRIN_H && defined(__GNUC__) && \
+    (defined(__x86_64__) || defined(__i386__))
+#include <nmmintrin.h>
+#define HAVE_CRC32C_SSE42 1
+#endif
+
 unsigned long __seed;
 
 /*
@@ -67,6 +77,62 @@ getnum(char *c)
 	return result;
 }
 
+/*
+ * getduration:
+ * Read a time with optional unit suffix (ns, us, ms, s, m, h) and
+ * return it in seconds.  A bare number is taken as seconds.  If 'end'
+ * is not NULL it is left pointing after the suffix.
+ */
+double
+getduration(char *c, char **end)
+{
+	double result;
+	char *p;
+
+	result = strtod(c, &p);
+	if (strncmp(p, "ns", 2) == 0) {
+		result /= 1e9;
+		p += 2;
+	} else if (strncmp(p, "us", 2) == 0) {
+		result /= 1e6;
+		p += 2;
+	} else if (strncmp(p, "ms", 2) == 0) {
+		result /= 1e3;
+		p += 2;
+	} else if (*p == 's') {
+		p++;
+	} else if (*p == 'm') {
+		result *= 60;
+		p++;
+	} else if (*p == 'h') {
+		result *= 3600;
+		p++;
+	}
+	if (end != NULL)
+		*end = p;
+	return result;
+}
+
+/*
+ * nanotime:
+ * Monotonic clock in nanoseconds, for timing individual operations.
+ */
+int64_t
+nanotime(void)
+{
+#if HAVE_CLOCK_GETTIME && defined(CLOCK_MONOTONIC)
+	struct timespec ts;
+
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (int64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+#else
+	struct timeval tv;
+
+	gettimeofday(&tv, NULL);
+	return (int64_t)tv.tv_sec * 1000000000 + tv.tv_usec * 1000;
+#endif
+}
+
 /*
  * initblock:
  * Initialise a block of memory with pseudo-random data or ascii sequence.
@@ -75,6 +141,18 @@ getnum(char *c)
  */
 void
 initblock(char *buf, long blockSize, dataType type, int64_t blockNum)
+{
+	initblock_r(buf, blockSize, type, blockNum, &__seed);
+}
+
+/*
+ * initblock_r:
+ * As initblock, with the state of the random data generator in *seed,
+ * so that threads can each have their own.
+ */
+void
+initblock_r(char *buf, long blockSize, dataType type, int64_t blockNum,
+    unsigned long *seed)
 {
 	int i, c, len;
 	static char ascii[('~' - ' ' + 1) * 44] = { '\0' };
@@ -109,9 +187,9 @@ initblock(char *buf, long blockSize, dataType type, int64_t blockNum)
 		 * given the brain-damaged algorithm.
 		 */
 		for (i = 0; i < (blockSize >> 1); i++, buf += 2)
-			*(short *)buf = RAND() >> 16;
+			*(short *)buf = RAND_R(seed) >> 16;
 		if ((i << 1) < blockSize)
-			*++buf = RAND() >> 8;
+			*buf = RAND_R(seed) >> 8;
 		break;
 	default:
 		fprintf(stderr, "Bad type: %d.\n", type);
@@ -119,6 +197,84 @@ initblock(char *buf, long blockSize, dataType type, int64_t blockNum)
 	}
 }
 
+/*
+ * crc32c:
+ * CRC32C (Castagnoli), the checksum of iSCSI, ext4 and btrfs.  Uses the
+ * SSE4.2 crc32 instruction where the CPU has it, and slice-by-8 tables
+ * otherwise.  The first call sets up the tables, so make it before
+ * starting any threads.
+ */
+static uint32_t crcTable[8][256];
+
+static uint32_t
+crcSlice8(uint32_t crc, const unsigned char *p, size_t len)
+{
+	uint32_t lo, hi;
+
+	for (; len >= 8; p += 8, len -= 8) {
+		lo = crc ^
+		    (p[0] | p[1] << 8 | p[2] << 16 | (uint32_t)p[3] << 24);
+		hi = p[4] | p[5] << 8 | p[6] << 16 | (uint32_t)p[7] << 24;
+		crc = crcTable[7][lo & 0xff] ^ crcTable[6][(lo >> 8) & 0xff] ^
+		    crcTable[5][(lo >> 16) & 0xff] ^ crcTable[4][lo >> 24] ^
+		    crcTable[3][hi & 0xff] ^ crcTable[2][(hi >> 8) & 0xff] ^
+		    crcTable[1][(hi >> 16) & 0xff] ^ crcTable[0][hi >> 24];
+	}
+	for (; len > 0; p++, len--)
+		crc = crcTable[0][(crc ^ *p) & 0xff] ^ (crc >> 8);
+	return crc;
+}
+
+#ifdef HAVE_CRC32C_SSE42
+__attribute__((target("sse4.2")))
+static uint32_t
+crcSse42(uint32_t crc, const unsigned char *p, size_t len)
+{
+#ifdef __x86_64__
+	uint64_t c;
+#endif
+
+	for (; len > 0 && ((uintptr_t)p & 7) != 0; p++, len--)
+		crc = _mm_crc32_u8(crc, *p);
+#ifdef __x86_64__
+	for (c = crc; len >= 8; p += 8, len -= 8)
+		c = _mm_crc32_u64(c, *(const uint64_t *)p);
+	crc = c;
+#endif
+	for (; len >= 4; p += 4, len -= 4)
+		crc = _mm_crc32_u32(crc, *(const uint32_t *)p);
+	for (; len > 0; p++, len--)
+		crc = _mm_crc32_u8(crc, *p);
+	return crc;
+}
+#endif
+
+uint32_t
+crc32c(uint32_t crc, const void *buf, size_t len)
+{
+	static uint32_t (*fn)(uint32_t, const unsigned char *, size_t);
+	uint32_t c;
+	int i, j;
+
+	if (fn == NULL) {
+		for (i = 0; i < 256; i++) {
+			for (c = i, j = 0; j < 8; j++)
+				c = c & 1 ? (c >> 1) ^ 0x82f63b78 : c >> 1;
+			crcTable[0][i] = c;
+		}
+		for (i = 0; i < 256; i++)
+			for (j = 1; j < 8; j++)
+				crcTable[j][i] = (crcTable[j - 1][i] >> 8) ^
+				    crcTable[0][crcTable[j - 1][i] & 0xff];
+		fn = crcSlice8;
+#ifdef HAVE_CRC32C_SSE42
+		if (__builtin_cpu_supports("sse4.2"))
+			fn = crcSse42;
+#endif
+	}
+	return ~fn(~crc, buf, len);
+}
+
 /*
  * getshm:
  * Two methods, either SYSV or mmap(2) style. Take your pick
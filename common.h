@@ -67,12 +67,17 @@ typedef enum { ALPHADATA, RANDDATA } dataType;
  */
 #define	SRAND(x) { __seed = x; }
 #define	RAND() (__seed = __seed * 1103515245L + 12345L)
+#define	RAND_R(s) (*(s) = *(s) * 1103515245L + 12345L)
 extern unsigned long __seed;
 
 /* Prototypes */
 int64_t	getnum(char *);
+double	getduration(char *, char **);
+int64_t	nanotime(void);
 void	initblock(char *, long, dataType, int64_t);
+void	initblock_r(char *, long, dataType, int64_t, unsigned long *);
 void	*getshm(long size);
 void	statusLine(double, double, const char *, const char *);
+uint32_t crc32c(uint32_t, const void *, size_t);
 
 #endif /* !COMMON_H */
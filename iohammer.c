@@ -32,89 +32,787 @@
 #include "iotools.h"
 #include "common.h"
 
+#include <math.h>
+
+#if HAVE_NANOSLEEP
+#include <time.h>
+#endif
+
+#ifndef M_PI
+#define M_PI	3.14159265358979323846
+#endif
+
 #ifdef BSD4_4
 #include <sys/disklabel.h>
 #endif
 
+#ifdef HAVE_SYS_MMAN_H
+#include <sys/mman.h>
+#endif
+
+#ifdef HAVE_SYS_IOCTL_H
+#include <sys/ioctl.h>
+#endif
+
+#ifdef HAVE_LINUX_FS_H
+#include <linux/fs.h>
+#endif
+
+#if defined(HAVE_LINUX_IO_URING_H) && defined(HAVE_SYS_SYSCALL_H)
+#include <sys/syscall.h>
+#include <linux/io_uring.h>
+#if defined(__NR_io_uring_setup) && defined(__NR_io_uring_enter)
+#define HAVE_IO_URING 1
+#endif
+#if HAVE_DECL_IORING_OP_URING_CMD && !defined(BLOCK_URING_CMD_DISCARD)
+#define BLOCK_URING_CMD_DISCARD	_IO(0x12, 0)	/* linux/blkdev.h, 6.12 */
+#endif
+#endif
+
+#if HAVE_SYS_UIO_H
+#include <sys/uio.h>
+#endif
+
+#if HAVE_SCHED_H
+#include <sched.h>
+#endif
+
+#if HAVE_SYS_WAIT_H
+#include <sys/wait.h>
+#endif
+
+#if HAVE_SYS_SYSMACROS_H
+#include <sys/sysmacros.h>
+#endif
+
+#if HAVE_SYS_RESOURCE_H
+#include <sys/resource.h>
+#endif
+
+#if defined(HAVE_LINUX_PERF_EVENT_H) && defined(HAVE_SYS_SYSCALL_H)
+#include <sys/syscall.h>
+#include <linux/perf_event.h>
+#ifdef __NR_perf_event_open
+#define HAVE_PERF_EVENT 1
+#endif
+#endif
+
+/* the CPU used by a worker alone: its thread, or its process */
+#if HAVE_GETRUSAGE && defined(USE_PTHREADS) && defined(RUSAGE_THREAD)
+#define RUSAGE_WORKER	RUSAGE_THREAD
+#elif HAVE_GETRUSAGE && !defined(USE_PTHREADS)
+#define RUSAGE_WORKER	RUSAGE_SELF
+#endif
+
+#if defined(HAVE_SCHED_SETAFFINITY) && defined(CPU_SETSIZE)
+#define HAVE_AFFINITY 1
+#endif
+
+#ifndef IOV_MAX
+#define IOV_MAX	16
+#endif
+
+/*
+ * An I/O request.  Each worker owns qdepth of them.
+ */
+struct ioreq {
+	int	write;
+	int	discard;	/* -D, neither read nor write */
+	int	target;		/* index into targets[] */
+	int	size;		/* index into bsizes[] */
+	int	fd;
+	int64_t	block;		/* in the address space, or -1 when free */
+	off_t	pos;
+	long	len;
+	char	*buf;
+	ssize_t	ret;		/* bytes transferred, or -errno */
+	int64_t	start;		/* nanotime() at submission, or when due */
+};
+
+#define HIST_SUB_BITS	6
+#define HIST_SUB	(1 << HIST_SUB_BITS)
+#define HIST_MAX_BITS	42		/* about 73 minutes, in ns */
+#define HIST_BUCKETS	((HIST_MAX_BITS - HIST_SUB_BITS + 1) * HIST_SUB)
+
+struct histogram {
+	int64_t	count, sum, min, max;
+	int64_t	bucket[HIST_BUCKETS];
+};
+
+/*
+ * Per-worker, per-target results, merged by main at the end of the run.
+ */
+struct stats {
+	struct histogram rd, wr;
+	struct histogram fl;		/* flushes, -F */
+	struct histogram dc;		/* discards, -D */
+	int64_t	rdBytes, wrBytes;
+	int64_t	verified, badVerify;	/* reads checked, -V */
+};
+
+/*
+ * Per-worker results for a region of a target, -H.
+ */
+struct region {
+	int64_t	writes;
+	struct histogram lat;		/* reads and writes together */
+};
+
+/*
+ * Block layer statistics of a device under the targets, as in
+ * /sys/dev/block/<major>:<minor>/stat: I/Os, merges, sectors and ms
+ * waited for reads, then writes, then I/Os in flight, ms busy, and ms
+ * waited summed over the I/Os in flight.
+ */
+enum { DS_RD, DS_RDMERGE, DS_RDSEC, DS_RDMS, DS_WR, DS_WRMERGE, DS_WRSEC,
+    DS_WRMS, DS_INFLIGHT, DS_BUSYMS, DS_QUEUEMS, DS_NSTAT };
+
+struct disk {
+	char	name[64];
+	char	path[64];
+	dev_t	dev;
+	uint64_t start[DS_NSTAT];	/* at the start of the run or phase */
+	uint64_t prev[DS_NSTAT];	/* at the last -o log record */
+	uint64_t cur[DS_NSTAT];
+	uint64_t sum[DS_NSTAT];		/* over the counted runs */
+	int64_t	startTime, prevTime;
+	double	secs;
+};
+
+/*
+ * A block size and its weight in the mix, from -b.
+ */
+struct bsize {
+	long	size;
+	double	weight;
+};
+
+/*
+ * A steady state criterion for a phase of a job, and its progress.
+ */
+struct steady {
+	int	bytes;		/* judge MiB/s rather than IOs/sec */
+	double	tolerance;	/* of the window's average */
+	int	rounds;		/* in the window; 0 for no criterion */
+	int64_t	round;		/* length of a round, ns */
+	double	*window;	/* results of the last rounds */
+	int	done;		/* rounds so far */
+	int	at;		/* rounds taken to reach it, or 0 */
+	int64_t	next, lastCount, lastTime;
+};
+
+/*
+ * A phase of a -j job: settings that override the command line while
+ * it runs, and its results.
+ */
+#define PHASE_KEYS	16
+
+struct phase {
+	char	name[32];
+	char	*key[PHASE_KEYS], *val[PHASE_KEYS];
+	int	nkeys;
+	int	report;		/* counted in the results */
+	struct steady steady;
+	double	secs;
+	struct stats res;	/* summed over workers and targets */
+};
+
+
+/*
+ * With -V, every block written starts with this header, and reads of
+ * blocks written earlier in the run are checked against it.
+ */
+#define VERIFY_MAGIC	0x56484f49	/* "IOHV" on little-endian */
+
+struct vheader {
+	uint32_t	magic;
+	uint32_t	crc;		/* CRC32C of the block, crc 0 */
+	uint64_t	pos;		/* byte offset within the target */
+	uint32_t	gen;		/* writes to the block this run */
+	uint32_t	target;
+	uint32_t	tid;
+	uint32_t	pad;
+};
+
+/*
+ * CPU used, by a worker or the whole process: user and system time in
+ * us, voluntary and involuntary context switches, and with -Y, cycles.
+ */
+struct cpuUse {
+	int64_t	user, sys;
+	int64_t	vcsw, ivcsw;
+	int64_t	cycles;
+};
+
+/*
+ * Per-worker counters, each on its own cache line (two, allowing for
+ * adjacent line prefetch) so workers never write a line another worker
+ * is writing.  Only the owner updates numio and numWrites; main and
+ * status() sum them when they need a total.  The stash is budget taken
+ * from the pool but not yet issued, and other workers may steal it.
+ */
+#define CACHE_LINE	128
+
+struct counters {
+	int64_t	numio;
+	int64_t	numWrites;
+	int64_t	stash;
+	char	pad[CACHE_LINE - 3 * sizeof(int64_t)];
+};
+
+#define BUDGET_CHUNK	1024	/* most I/Os taken from the pool at once */
+
+#if HAVE_ATOMIC_BUILTINS
+#define ATOMIC_LOAD(p)		__atomic_load_n((p), __ATOMIC_RELAXED)
+#define ATOMIC_STORE(p, v)	__atomic_store_n((p), (v), __ATOMIC_RELAXED)
+#define ATOMIC_ADD(p, v)	__atomic_add_fetch((p), (v), __ATOMIC_RELAXED)
+#define ATOMIC_CAS(p, o, n)	__atomic_compare_exchange_n((p), &(o), (n), \
+				    0, __ATOMIC_ACQ_REL, __ATOMIC_RELAXED)
+#elif defined(USE_PTHREADS)
+static int64_t	atomicAdd(int64_t *, int64_t);
+static int	atomicCas(int64_t *, int64_t, int64_t);
+#define ATOMIC_LOAD(p)		(*(volatile int64_t *)(p))
+#define ATOMIC_STORE(p, v)	(*(volatile int64_t *)(p) = (v))
+#define ATOMIC_ADD(p, v)	atomicAdd((p), (v))
+#define ATOMIC_CAS(p, o, n)	atomicCas((p), (o), (n))
+#else
+/* worker processes without atomics each have a fixed share of -c */
+#define ATOMIC_LOAD(p)		(*(volatile int64_t *)(p))
+#define ATOMIC_STORE(p, v)	(*(volatile int64_t *)(p) = (v))
+#define FIXED_SHARES	1
+#endif
+
+/*
+ * What the workers share while they run, in shared memory for the
+ * multi-process build.
+ */
+struct control {
+	int64_t	pool;		/* budget not yet handed to any worker */
+	int64_t	deadline;	/* nanotime() at which the run ends, or 0 */
+	int64_t	aborted;	/* a worker failed, so all stop */
+};
+
+/*
+ * A target, from -f.  With several, the blocks of all of them make up
+ * one address space for the access pattern: striped across the targets
+ * (-m rr), or laid end to end (-m size).
+ */
+typedef enum { SPREAD_RR, SPREAD_SIZE } spreadType;
+
+struct target {
+	char	name[PATH_MAX];
+	int64_t	size;
+	int64_t	blocks;
+	int64_t	first;		/* first block in the address space, -m size */
+	int	*fds;		/* one per worker */
+	long	align;		/* direct I/O alignment, or 0 */
+	long	lsec, psec;	/* logical and physical sector, or 0 */
+	long	optio;		/* optimal I/O size, or 0 */
+	int	blkdev;
+	int64_t	regionSize;	/* bytes in each region of -H */
+};
+
+/*
+ * An I/O of a -x or -X trace.  The binary form is a traceHeader, then
+ * the records, in the byte order of the machine that wrote them.
+ */
+#define TRACE_MAGIC	"IOHTRACE"
+#define TRACE_ORDER	0x01020304
+
+struct traceHeader {
+	char	magic[8];
+	uint32_t order;		/* TRACE_ORDER, to catch the other byte order */
+	uint32_t version;
+};
+
+struct traceRec {
+	uint64_t time;		/* ns since the start */
+	uint64_t pos;		/* byte offset */
+	uint32_t len;
+	uint16_t target;
+	uint8_t	write;
+	uint8_t	discard;
+};
+
+/*
+ * Per-worker state handed to the engine.
+ */
+struct worker {
+	int	tid;
+	int	inflight;
+	int64_t	next;		/* next block, sequential patterns */
+	int64_t	due;		/* intended issue time of the next I/O, -R */
+	int64_t	rec;		/* next I/O of the -x trace */
+	int64_t	writes;		/* issued, for -F every n */
+	int	flushDue;	/* a flush waits for the I/Os in flight */
+	struct ioreq flush;	/* the write it follows */
+	int64_t	wake;		/* if set, reap() may return empty by then */
+	uint64_t rng[4];	/* xoshiro256** state */
+	unsigned long dataSeed;	/* for -r data */
+	struct ioreq *reqs;
+	struct ioreq **done;	/* filled by reap() */
+	int	ndone;
+	int	perfFd;		/* -Y cycle counter */
+	void	*priv;		/* engine private */
+};
+
+/*
+ * An I/O engine.  submit() queues a request, reap() waits for at least
+ * one completion and returns the number placed in w->done.  An engine
+ * that blocks in reap() should give up at w->wake, if set, returning
+ * zero; open-loop workers use that to issue I/Os on time.  Optional
+ * hooks: setup() is called once per target, on its first descriptor,
+ * after the targets are opened; init()/fini() in each worker.
+ */
+struct ioengine {
+	const char	*name;
+	const char	*desc;
+	int		flags;
+	void		(*setup)(int target, int fd, int64_t size, int access);
+	void		(*init)(struct worker *);
+	void		(*submit)(struct worker *, struct ioreq *);
+	int		(*reap)(struct worker *);
+	void		(*fini)(struct worker *);
+};
+
+#define ENG_ASYNC	0x01	/* may keep more than one I/O in flight */
+#define ENG_NODATA	0x02	/* never touches the target */
+#define ENG_NODIRECT	0x04	/* always goes through the page cache */
+
+/*
+ * Access pattern, from -p.
+ */
+typedef enum { PAT_RAND, PAT_SEQ, PAT_STRIDE, PAT_ZIPF, PAT_HOT } patType;
+
+struct pattern {
+	patType	type;
+	int64_t	stride, step;		/* stride in bytes, and blocks */
+	double	theta;			/* zipf */
+	double	hx1, hn, s;		/* zipf, from patternInit() */
+	double	hotIO, hotSpace;	/* hot: fractions of I/O and space */
+	int64_t	hotBlocks;
+};
+
+/*
+ * Flushes, from -F.
+ */
+typedef enum {
+	FLUSH_NONE, FLUSH_FSYNC, FLUSH_FDATASYNC, FLUSH_RANGE
+} flushType;
+
+/*
+ * The settings a phase may change, as given on the command line.
+ */
+struct settings {
+	int	writePct, discardPct;
+	flushType flushKind;
+	int	flushEvery, flushLim;
+	int64_t	iolimit;
+	double	duration, rate;
+	int	ratePoisson;
+	struct pattern pattern;
+	struct bsize *bsizes;
+	int	nsizes;
+	long	blockSize, maxBlockSize;
+	double	sizeWeight;
+};
+
+/*
+ * Latency distribution for the sim engine, in nanoseconds.
+ */
+typedef enum { LAT_FIXED, LAT_UNIFORM, LAT_EXP, LAT_NORMAL } latDist;
+
+struct latency {
+	latDist	dist;
+	double	a, b;
+};
+
 /* Prototypes */
 static void	*doIO(void *);
+static int64_t	claim(int, int64_t);
+static int64_t	totalIO(int64_t *);
+static void	histRecord(struct histogram *, int64_t);
+static void	histMerge(struct histogram *, const struct histogram *);
+static void	printLatency(const char *, const struct histogram *, int);
+static int64_t	histPercentile(const struct histogram *, double);
+static void	histDiff(struct histogram *, const struct histogram *,
+		    const struct histogram *);
+static void	logSample(int64_t, int);
+static void	logField(const char *, const char *, double, int);
+static void	printBreakdown(const char *, const char **,
+		    const struct stats *, int, double, int);
+static void	parseBlockSizes(char *);
+static int	pickSize(struct worker *);
+static off_t	blockPos(struct worker *, int64_t, long, int);
+static void	parseAlign(char *);
+static void	parseLatency(char *);
+static void	parsePattern(char *);
+static void	parseRate(char *);
+static void	parseFlush(char *);
+static int	flushIO(struct worker *, struct stats *);
+static int64_t	interArrival(struct worker *);
+static int64_t	sleepUntil(int64_t);
+static void	patternInit(void);
+static void	rngSeed(struct worker *);
+static uint64_t	rngNext(struct worker *);
+static int64_t	nextBlock(struct worker *, int64_t);
+static int	mapBlock(int64_t *);
+static int	reqBusy(struct worker *, int64_t);
+static void	verifyStamp(struct worker *, struct ioreq *);
+static int	verifyCheck(struct worker *, struct ioreq *, struct stats *);
+static void	nullSubmit(struct worker *, struct ioreq *);
+static void	simInit(struct worker *);
+static void	simSubmit(struct worker *, struct ioreq *);
+static int	simReap(struct worker *);
+static void	simFini(struct worker *);
+static int	syncReap(struct worker *);
+static void	syncSubmit(struct worker *, struct ioreq *);
+#if HAVE_PREAD && HAVE_PWRITE
+static void	psyncSubmit(struct worker *, struct ioreq *);
+#endif
+#if HAVE_PREADV && HAVE_PWRITEV
+static void	vsyncSubmit(struct worker *, struct ioreq *);
+#endif
+#ifdef HAVE_SYS_MMAN_H
+static void	mmapSetup(int, int, int64_t, int);
+static void	mmapSubmit(struct worker *, struct ioreq *);
+#endif
+#ifdef HAVE_IO_URING
+static void	uringInit(struct worker *);
+static void	uringSubmit(struct worker *, struct ioreq *);
+static int	uringReap(struct worker *);
+static void	uringFini(struct worker *);
+#endif
+#ifdef USE_PTHREADS
 static void	*status(void *);
+static void	*sampler(void *);
+static void	*steadyWatch(void *);
+#endif
 static void	cleanup(int);
 static void	usage();
+static void	addTarget(const char *);
+static void	provision(int, const char *, int64_t);
 static void	openfile(int **fds, char *name, int64_t *size,
 		    int threads, int access);
+static long	getAlignment(int fd);
+static void	getGeometry(struct target *);
+static void	printGeometry(int);
+static void	findDisks(void);
+static int	diskRead(const struct disk *, uint64_t *);
+static void	diskSample(int);
+static void	printDisks(int);
+static int	perfOpen(void);
+static void	cpuNow(struct cpuUse *, int, int);
+static void	cpuAdd(struct cpuUse *, const struct cpuUse *, int);
+#if HAVE_GETRUSAGE
+static void	usageAdd(struct cpuUse *, int);
+#endif
+static void	printCpu(int, double);
+static ssize_t	discardRange(struct ioreq *);
+static void	placeWorkers(char *);
+static void	layout(void);
+static double	runWorkers(int);
+static double	runJob(const struct settings *, int);
+static void	readJob(const char *);
+static void	saveSettings(struct settings *);
+static void	restoreSettings(const struct settings *);
+static void	applyPhase(struct phase *, const struct settings *);
+static void	parseSteady(struct steady *, const char *, char *);
+static void	steadyStart(struct steady *);
+static int	steadyRound(struct steady *, int64_t);
+static int64_t	statsTotal(int);
+static void	printPhases(int);
+static void	parseSweep(char *);
+static void	parseSlo(char *);
+static double	runSweep(int);
+static void	printSweep(int);
+static void	parseHeat(char *);
+static void	writeHeat(void);
+static void	printPlacement(int);
+static void	loadTrace(const char *);
+static void	traceText(FILE *, const char *);
+static int	traceCmp(const void *, const void *);
+static void	checkTrace(void);
+static void	traceReq(struct worker *, struct ioreq *);
+static void	traceRecord(FILE *, const struct ioreq *);
+static void	saveTrace(const char *);
+#if HAVE_AFFINITY
+static int	parseCpuList(char *, cpu_set_t *);
+static void	nodeCpus(int, cpu_set_t *);
+static void	cpuListString(const cpu_set_t *, char *, size_t);
+#endif
 
 /* Globals */
-static int ignore, threads, type, writeLim, *fds;
-static int flAborted;
-static long blockSize;
+static int ignore, threads, type, writeLim, discardLim;
+static int64_t flAborted;	/* set by workers and SIGINT, so atomic */
+static int qdepth, direct;
+static long bufAlign;
+static const struct ioengine *engine;
+static long blockSize;		/* the smallest size, and unit of offsets */
+static long maxBlockSize;
+static long ioAlign;		/* -A, random I/Os start at multiples */
+static int64_t ioOffset;	/* -A, bytes every I/O is shifted by */
+static struct bsize *bsizes;
+static int nsizes;
+static double sizeWeight;	/* sum of the weights */
+static struct stats *sstats;	/* per worker and block size, for a mix */
 static int64_t iolimit, fileBlocks;
+static int64_t patBlocks;	/* blocks the access pattern ranges over */
+static int verify;
+static uint64_t seed;		/* -S, or from the clock */
+static int allocOnly;		/* -P alloc: temporary files left unwritten */
+static uint32_t *genMap;	/* last generation written to each block */
 static int64_t numio, numWrites;
+static struct latency simLat = { LAT_FIXED, 100000.0, 0 };
+static struct pattern pattern;
+static struct target *targets;
+static int ntargets;
+static spreadType spread;
+static double rate;		/* -R, total IOs/sec, or 0 for closed loop */
+static int ratePoisson;
+static flushType flushKind;	/* -F */
+static int flushEvery;		/* flush after every nth write, or */
+static int flushLim;		/* after this share of them, of 1024 */
+static const char *flushNames[] = {
+	"none", "fsync", "fdatasync", "sync_file_range"
+};
+static struct stats *wstats;
+static int writePct, discardPct;
+static double duration;		/* -T, in seconds */
+static struct phase *phases;	/* -j job */
+static int nphases;
+static struct phase *curPhase;	/* the phase running, or NULL */
+static struct phase *levels;	/* -Q sweep, a phase per level */
+static int *sweep, nsweep;	/* its threads or queue depths */
+static int sweepDepth;		/* sweeping the depth, not threads */
+static double sloPct;		/* -K percentile, or 0 */
+static int64_t sloLat;		/* and its limit, in ns */
+static char *heatName;		/* -H heatmap */
+static int heatRegions;		/* regions of each target */
+static struct region *heat;	/* per worker, target and region */
+static struct disk *disks;
+static int ndisks;
+static FILE *logFile;		/* -o interval log */
+static int logJSON;		/* JSON lines rather than CSV */
+static int64_t logEvery;	/* -I, in ns */
+static int64_t logStart;	/* nanotime() at the start of the run */
+static struct traceRec *trace;	/* -x, sorted by time */
+static int64_t ntrace;
+static int traceFast;		/* replay as fast as possible */
+static FILE **recFiles;		/* -X, what each worker issued */
+#if HAVE_AFFINITY
+static cpu_set_t *placement;	/* -C: the CPUs each worker may run on */
+static int *placeNode;		/* and its node, or -1 */
+#endif
+
+/* latency percentiles reported */
+static const double pcts[] = { 50, 90, 99, 99.9, 99.99 };
 
+static struct control *ctl;
+static struct counters *wcount;
+static struct cpuUse *wcpu;	/* per worker, of the last run */
+static struct cpuUse workCpu;	/* the workers, over the counted runs */
+static struct cpuUse procCpu;	/* and the whole process */
+static int countCycles;		/* -Y */
 #ifdef USE_PTHREADS
+static int flFinished;
+#if !HAVE_ATOMIC_BUILTINS
 static pthread_mutex_t lock;
-static pthread_cond_t cond;
-#else
-static int *pipe_ctl_r, *pipe_ctl_w, *pipe_cnt_r, *pipe_cnt_w;
+#endif
 #endif
 
+static const struct ioengine engines[] = {
+	{ "sync", "lseek(2) then read(2)/write(2)", 0,
+	    NULL, NULL, syncSubmit, syncReap, NULL },
+#if HAVE_PREAD && HAVE_PWRITE
+	{ "psync", "pread(2)/pwrite(2)", 0,
+	    NULL, NULL, psyncSubmit, syncReap, NULL },
+#endif
+#if HAVE_PREADV && HAVE_PWRITEV
+	{ "vsync", "preadv(2)/pwritev(2), one iovec per page", 0,
+	    NULL, NULL, vsyncSubmit, syncReap, NULL },
+#endif
+#ifdef HAVE_SYS_MMAN_H
+	{ "mmap", "memcpy(3) through a shared mapping", ENG_NODIRECT,
+	    mmapSetup, NULL, mmapSubmit, syncReap, NULL },
+#endif
+#ifdef HAVE_IO_URING
+	{ "uring", "Linux io_uring, up to -q I/Os in flight", ENG_ASYNC,
+	    NULL, uringInit, uringSubmit, uringReap, uringFini },
+#endif
+	{ "null", "complete at once, target untouched",
+	    ENG_ASYNC | ENG_NODATA, NULL, NULL, nullSubmit, syncReap, NULL },
+	{ "sim", "complete after a -L latency, target untouched",
+	    ENG_ASYNC | ENG_NODATA,
+	    NULL, simInit, simSubmit, simReap, simFini },
+	{ NULL }
+};
+
 int
 main(int argc, char **argv)
 {
-	int c, i, unformatted, writePct;
-	int flVerbose;
-	int64_t fileSize;
+	int c, i, t, k, unformatted, access;
+	size_t n;
+	int flVerbose, seeded, bsDefault;
+	int64_t fileSize, verified, badVerify, bytes;
+	double interval;
+	char *logName, *cpus, *job, *replay, *record;
 	double secs;
-	struct timeval startTime, endTime;
-	char fileName[PATH_MAX];
-#ifdef USE_PTHREADS
-	pthread_t *tid, status_tid;
-	pthread_attr_t attr;
-#else
-	char tok;
-	int fdmax, p[2];
-	pid_t *pid;
-	fd_set rdset;
-	struct timeval tmout;
-#endif
+	struct histogram rdLat, wrLat, flLat, dcLat;
+	struct settings base;
+	char label[32], *p, **labels;
 
 	/* Set defaults */
-	blockSize = 512;
-	strncpy(fileName, ".", sizeof(fileName)-1);
 	fileSize = 0;
+	logName = cpus = job = replay = record = NULL;
+	interval = 1;
+	spread = SPREAD_RR;
 	ignore = 0;
 	numio = 0;
 	threads = 8;
 	type = ALPHADATA;
 	unformatted = 0;
-	writePct = 0;
+	writePct = discardPct = 0;
 	flVerbose = 0;
+	seeded = 0;
+	engine = &engines[0];
+	qdepth = 1;
+	direct = 0;
+	duration = 0;
 
 	flAborted = 0;
 
-	while ((c = getopt(argc, argv, "raiuvb:c:w:t:s:f:?")) != EOF) {
+	while ((c = getopt(argc, argv, "raiduvVYA:b:C:c:D:e:F:H:j:K:m:p:q:"
+	    "w:t:s:f:L:P:Q:R:I:o:S:T:x:X:?")) != EOF) {
 		switch (c) {
 		case 'a':
 			type = ALPHADATA;
 			break;
+		case 'A':
+			parseAlign(optarg);
+			break;
 		case 'b':
-			blockSize = getnum(optarg);
+			parseBlockSizes(optarg);
+			break;
+		case 'C':
+			cpus = optarg;
 			break;
 		case 'c':
 			iolimit = getnum(optarg);
 			break;
+		case 'd':
+			direct = 1;
+			break;
+		case 'e':
+			for (engine = engines; engine->name != NULL; engine++)
+				if (strcmp(optarg, engine->name) == 0)
+					break;
+			if (engine->name == NULL) {
+				fprintf(stderr, "Unknown I/O engine: %s\n",
+				    optarg);
+				usage();
+				exit(1);
+			}
+			break;
 		case 'f':
-			strncpy(fileName, optarg, sizeof(fileName));
+			addTarget(optarg);
+			break;
+		case 'F':
+			parseFlush(optarg);
+			break;
+		case 'H':
+			parseHeat(optarg);
 			break;
 		case 'i':
 			ignore = 1;
 			break;
+		case 'L':
+			parseLatency(optarg);
+			break;
+		case 'm':
+			if (strcmp(optarg, "rr") == 0)
+				spread = SPREAD_RR;
+			else if (strcmp(optarg, "size") == 0)
+				spread = SPREAD_SIZE;
+			else {
+				fprintf(stderr, "Unknown target spread: %s\n",
+				    optarg);
+				usage();
+				exit(1);
+			}
+			break;
+		case 'p':
+			parsePattern(optarg);
+			break;
+		case 'P':
+			if (strcmp(optarg, "alloc") == 0)
+				allocOnly = 1;
+			else if (strcmp(optarg, "write") == 0)
+				allocOnly = 0;
+			else {
+				fprintf(stderr, "Unknown provisioning: %s\n",
+				    optarg);
+				usage();
+				exit(1);
+			}
+			break;
+		case 'q':
+			qdepth = atoi(optarg);
+			if (qdepth <= 0) {
+				fprintf(stderr, "Invalid queue depth: %d\n",
+				    qdepth);
+				usage();
+				exit(1);
+			}
+			break;
 		case 'r':
 			type = RANDDATA;
 			break;
+		case 'R':
+			parseRate(optarg);
+			break;
 		case 's':
 			fileSize = getnum(optarg);
 			break;
+		case 'S':
+			seed = strtoull(optarg, &p, 0);
+			if (*p != '\0' || *optarg == '\0') {
+				fprintf(stderr, "Invalid seed: %s\n", optarg);
+				usage();
+				exit(1);
+			}
+			seeded = 1;
+			break;
+		case 'j':
+			job = optarg;
+			break;
+		case 'K':
+			parseSlo(optarg);
+			break;
+		case 'Q':
+			parseSweep(optarg);
+			break;
+		case 'I':
+			interval = getduration(optarg, &p);
+			if (*p != '\0' || interval <= 0) {
+				fprintf(stderr, "Invalid interval: %s\n",
+				    optarg);
+				usage();
+				exit(1);
+			}
+			break;
+		case 'o':
+			logName = optarg;
+			break;
+		case 'T':
+			duration = getduration(optarg, &p);
+			if (*p != '\0' || duration <= 0) {
+				fprintf(stderr, "Invalid duration: %s\n",
+				    optarg);
+				usage();
+				exit(1);
+			}
+			break;
 		case 't':
 			threads = atoi(optarg);
 			if (threads <= 0) {
@@ -130,11 +828,28 @@ main(int argc, char **argv)
 		case 'v':
 			flVerbose = 1;
 			break;
+		case 'V':
+			verify = 1;
+			break;
+		case 'Y':
+			countCycles = 1;
+			break;
 		case 'w':
 			writePct = atoi(optarg);
 			if (writePct > 100)
 				writePct = 100;
 			break;
+		case 'D':
+			discardPct = atoi(optarg);
+			if (discardPct > 100)
+				discardPct = 100;
+			break;
+		case 'x':
+			replay = optarg;
+			break;
+		case 'X':
+			record = optarg;
+			break;
 		case '?':
 		default:
 			usage();
@@ -142,10 +857,195 @@ main(int argc, char **argv)
 		}
 	}
 
-	openfile(&fds, fileName, &fileSize, threads, writePct == 0 ?
-	    O_RDONLY : O_RDWR);
-	if (fileSize == 0)
-		fileSize = 1048576L;
+	if (logName != NULL) {
+		if ((logFile = fopen(logName, "w")) == NULL) {
+			fprintf(stderr, "Can't open '%s': %s\n", logName,
+			    strerror(errno));
+			exit(1);
+		}
+		p = strrchr(logName, '.');
+		logJSON = p != NULL &&
+		    (strcmp(p, ".json") == 0 || strcmp(p, ".jsonl") == 0);
+		logEvery = interval * 1e9;
+	}
+	if (levels != NULL) {
+		if (verify || job != NULL || replay != NULL || rate > 0) {
+			fprintf(stderr, "A sweep can't be run with -V, -j, -x "
+			    "or -R\n");
+			exit(1);
+		}
+		if (iolimit == 0 && duration == 0) {
+			fprintf(stderr, "A sweep needs -c or -T to end each "
+			    "level\n");
+			exit(1);
+		}
+		/* open and set up for the most, and run with fewer */
+		if (sweepDepth)
+			qdepth = sweep[nsweep - 1];
+		else
+			threads = sweep[nsweep - 1];
+	} else if (sloPct > 0) {
+		fprintf(stderr, "A latency target (-K) needs a sweep (-Q)\n");
+		exit(1);
+	}
+	if (!(engine->flags & ENG_ASYNC) && qdepth > 1) {
+		fprintf(stderr, "Queue depth > 1 requires an asynchronous "
+		    "engine, not '%s'\n", engine->name);
+		exit(1);
+	}
+#if !defined(O_DIRECT) && !defined(F_NOCACHE)
+	if (direct) {
+		fprintf(stderr, "Direct I/O not supported on this platform\n");
+		exit(1);
+	}
+#endif
+	if (verify && (engine->flags & ENG_NODATA)) {
+		fprintf(stderr, "Nothing to verify with the '%s' engine\n",
+		    engine->name);
+		exit(1);
+	}
+	if (flushKind != FLUSH_NONE && (engine->flags & ENG_NODATA)) {
+		fprintf(stderr, "Nothing to flush with the '%s' engine\n",
+		    engine->name);
+		exit(1);
+	}
+	if (countCycles && (i = perfOpen()) < 0) {
+		fprintf(stderr, "Can't count CPU cycles: %s\n",
+		    errno == ENOENT || errno == ENODEV ? "no hardware "
+		    "counter for them" : errno == EACCES ? "not allowed, see "
+		    "/proc/sys/kernel/perf_event_paranoid" : strerror(errno));
+		exit(1);
+	} else if (countCycles)
+		close(i);
+	if (writePct + discardPct > 100) {
+		fprintf(stderr, "Write and discard percentages add up to "
+		    "more than 100\n");
+		exit(1);
+	}
+	if (verify && ioAlign > 0) {
+		fprintf(stderr, "Verify can't be used with an alignment "
+		    "(-A)\n");
+		exit(1);
+	}
+	/* until the targets' sectors are known */
+	bsDefault = nsizes == 0;
+	if (bsDefault)
+		parseBlockSizes("512");
+	access = writePct == 0 && discardPct == 0 ? O_RDONLY : O_RDWR;
+	if (job != NULL) {
+		readJob(job);
+		for (i = 0; i < nphases; i++)
+			for (k = 0; k < phases[i].nkeys; k++)
+				if ((strcmp(phases[i].key[k], "write") == 0 ||
+				    strcmp(phases[i].key[k], "discard") == 0) &&
+				    atoi(phases[i].val[k]) > 0)
+					access = O_RDWR;
+	}
+	if (replay != NULL) {
+		if (verify || job != NULL || rate > 0 || ioAlign > 0 ||
+		    ioOffset > 0) {
+			fprintf(stderr, "A trace can't be replayed with -V, "
+			    "-j, -R or -A\n");
+			exit(1);
+		}
+		loadTrace(replay);
+		/* -c replays just the first I/Os */
+		if (iolimit > 0 && iolimit < ntrace)
+			ntrace = iolimit;
+		iolimit = 0;
+		if (threads > ntrace)
+			threads = ntrace;
+		for (i = 0; i < ntrace; i++)
+			if (trace[i].write || trace[i].discard)
+				access = O_RDWR;
+	}
+	if (verify && nsizes > 1) {
+		fprintf(stderr, "Verify needs a single block size\n");
+		exit(1);
+	}
+	if (verify && blockSize < sizeof(struct vheader)) {
+		fprintf(stderr, "Block size must be at least %d bytes to "
+		    "verify\n", (int)sizeof(struct vheader));
+		exit(1);
+	}
+	if (direct && (engine->flags & ENG_NODIRECT)) {
+		fprintf(stderr, "Direct I/O makes no sense with the '%s' "
+		    "engine\n", engine->name);
+		exit(1);
+	}
+
+	if (ntargets == 0)
+		addTarget(".");
+	for (t = 0; t < ntargets; t++) {
+		targets[t].size = fileSize;
+		openfile(&targets[t].fds, targets[t].name, &targets[t].size,
+		    threads, access);
+		if (targets[t].size == 0)
+			targets[t].size = 1048576L;
+		getGeometry(&targets[t]);
+		/* without -b, whole physical sectors */
+		if (bsDefault && targets[t].psec > blockSize) {
+			snprintf(label, sizeof(label), "%ld",
+			    targets[t].psec);
+			parseBlockSizes(label);
+		}
+	}
+
+	/* buffers are page aligned, or better if direct I/O needs it */
+	bufAlign = sysconf(_SC_PAGESIZE);
+	for (t = 0; direct && t < ntargets; t++) {
+		if ((targets[t].align = getAlignment(targets[t].fds[0])) == 0) {
+			fprintf(stderr, "Direct I/O not supported on '%s'\n",
+			    targets[t].name);
+			exit(1);
+		}
+		if (bufAlign < targets[t].align)
+			bufAlign = targets[t].align;
+	}
+	for (t = 0; engine->setup != NULL && t < ntargets; t++)
+		engine->setup(t, targets[t].fds[0], targets[t].size, access);
+	if (!(engine->flags & ENG_NODATA))
+		findDisks();
+
+	if (iolimit > 0 && threads > iolimit && phases == NULL &&
+	    levels == NULL)
+		threads = iolimit;
+	writeLim = (writePct << 10) / 100;
+	discardLim = (discardPct << 10) / 100;
+	layout();
+	if (trace != NULL)
+		checkTrace();
+	fileSize = ntargets == 1 ? targets[0].size : fileBlocks * blockSize;
+
+	/*
+	 * Verifying, each worker keeps to its own share of the blocks, so
+	 * that it alone knows what each of them should hold.
+	 */
+	if (verify) {
+		if (patBlocks <= qdepth) {
+			fprintf(stderr, "Too few blocks to verify with %d "
+			    "threads of depth %d\n", threads, qdepth);
+			exit(1);
+		}
+		MYASSERT((genMap = calloc(fileBlocks, sizeof(*genMap))) !=
+		    NULL, "calloc failed");
+		crc32c(0, NULL, 0);
+	}
+	if (cpus != NULL)
+		placeWorkers(cpus);
+	if (record != NULL) {
+		MYASSERT((recFiles = malloc(threads * sizeof(*recFiles))) !=
+		    NULL, "malloc failed");
+		for (i = 0; i < threads; i++)
+			MYASSERT((recFiles[i] = tmpfile()) != NULL,
+			    "tmpfile failed");
+	}
+
+	/* check every phase of a job before running any of them */
+	saveSettings(&base);
+	for (i = 0; i < nphases; i++)
+		applyPhase(&phases[i], &base);
+	restoreSettings(&base);
 
 	if (!unformatted) {
 		printf("Size %" PRId64 ": ", fileSize);
@@ -154,67 +1054,278 @@ main(int argc, char **argv)
 			fputc('\n', stderr);
 	}
 
-	writeLim = (writePct << 10) / 100;
-	fileBlocks = fileSize / blockSize;
-	if (iolimit > 0 && threads > iolimit)
-		threads = iolimit;
+	if (!seeded)
+		seed = nanotime() ^ ((uint64_t)getpid() << 40);
 
 	signal(SIGINT, &cleanup);
 
 #ifdef USE_PTHREADS
-	MYASSERT((tid = malloc(threads * sizeof(pthread_t))) != NULL,
-	    "malloc failed");
+	wstats = calloc(threads * ntargets, sizeof(*wstats));
+	if (nsizes > 1 && phases == NULL && trace == NULL)
+		sstats = calloc(threads * nsizes, sizeof(*sstats));
+	ctl = calloc(1, sizeof(*ctl));
+	wcpu = calloc(threads, sizeof(*wcpu));
+#else
+	wstats = getshm(threads * ntargets * sizeof(*wstats));
+	if (nsizes > 1 && phases == NULL && trace == NULL)
+		sstats = getshm(threads * nsizes * sizeof(*sstats));
+	ctl = getshm(sizeof(*ctl));
+	wcount = getshm(threads * sizeof(*wcount));
+	wcpu = getshm(threads * sizeof(*wcpu));
+#endif
+	MYASSERT(wstats != NULL && (sstats != NULL || nsizes == 1 ||
+	    phases != NULL || trace != NULL) && ctl != NULL && wcpu != NULL,
+	    "calloc failed");
+	if (heatName != NULL) {
+		n = (size_t)threads * ntargets * heatRegions * sizeof(*heat);
+#ifdef USE_PTHREADS
+		heat = calloc(1, n);
+#else
+		heat = getshm(n);
+#endif
+		MYASSERT(heat != NULL, "calloc failed");
+		for (t = 0; t < ntargets; t++)
+			targets[t].regionSize = (targets[t].size +
+			    heatRegions - 1) / heatRegions;
+	}
+#if defined(USE_PTHREADS) && !HAVE_ATOMIC_BUILTINS
 	MYASSERT(pthread_mutex_init(&lock, NULL) == 0,
 	    "pthread_mutex_init failed");
-	MYASSERT(pthread_cond_init(&cond, NULL) == 0,
-	    "pthread_cond_init failed");
-	MYASSERT(pthread_attr_init(&attr) == 0,
-	    "pthread_attr_init failed");
-	MYASSERT(pthread_attr_setdetachstate(&attr,
-	    PTHREAD_CREATE_DETACHED) == 0,
-	    "pthread_attr_setdetachstate failed");
-	for (i = 0; i < threads; i++) {
-		MYASSERT(pthread_create(&tid[i], &attr, &doIO,
-		    (void *)(intptr_t)i) == 0,
-		    "pthread_create failed");
-	}
-	MYASSERT(pthread_attr_destroy(&attr) == 0,
-	    "pthread_attr_destroy failed");
+#endif
 
-	MYASSERT(gettimeofday(&startTime, NULL) == 0, "gettimeofday failed");
-	if (flVerbose) {
-		MYASSERT(pthread_create(&status_tid, NULL, &status, NULL) == 0,
-		    "pthread_create failed");
+	if (phases != NULL)
+		secs = runJob(&base, flVerbose);
+	else if (levels != NULL)
+		secs = runSweep(flVerbose);
+	else
+		secs = runWorkers(flVerbose);
+	if (logFile != NULL)
+		fclose(logFile);
+	if (record != NULL)
+		saveTrace(record);
+	if (heat != NULL)
+		writeHeat();
+	if (ATOMIC_LOAD(&flAborted))
+		fprintf(stderr, "I/O aborted.\n");
+	memset(&rdLat, 0, sizeof(rdLat));
+	memset(&wrLat, 0, sizeof(wrLat));
+	memset(&flLat, 0, sizeof(flLat));
+	memset(&dcLat, 0, sizeof(dcLat));
+	verified = badVerify = bytes = 0;
+	for (i = 0; i < threads * ntargets; i++) {
+		histMerge(&rdLat, &wstats[i].rd);
+		histMerge(&wrLat, &wstats[i].wr);
+		histMerge(&flLat, &wstats[i].fl);
+		histMerge(&dcLat, &wstats[i].dc);
+		bytes += wstats[i].rdBytes + wstats[i].wrBytes;
+		verified += wstats[i].verified;
+		badVerify += wstats[i].badVerify;
 	}
-
-	/* wait for the threads to finish */
-	MYASSERT(pthread_mutex_lock(&lock) == 0,
-	    "pthread_mutex_lock failed");
-	while ((iolimit == 0 || numio < iolimit) && !flAborted)
-		MYASSERT(pthread_cond_wait(&cond, &lock) == 0,
-		    "pthread_cond_wait failed");
-	MYASSERT(pthread_mutex_unlock(&lock) == 0,
-	    "pthread_mutex_unlock failed");
-	if (flVerbose)
-		pthread_join(status_tid, NULL);
-#else
-	MYASSERT((pid = malloc(threads * sizeof(pid_t))) != NULL,
-	    "malloc failed");
-	MYASSERT((pipe_ctl_r = (int *) malloc(threads * sizeof(int))) != NULL,
-	    "malloc failed");
-	MYASSERT((pipe_ctl_w = (int *) malloc(threads * sizeof(int))) != NULL,
-	    "malloc failed");
-	MYASSERT((pipe_cnt_r = (int *) malloc(threads * sizeof(int))) != NULL,
+	if (unformatted) {
+		printf("%"PRId64"\t%d\t%ld\t%d\t%"PRId64"\t%"PRId64"\t%lf\t%lf",
+		    fileSize,
+		    threads, blockSize, writePct, numio, numWrites, secs,
+		    numio / secs);
+		printLatency("read", &rdLat, 1);
+		printLatency("write", &wrLat, 1);
+		if (verify)
+			printf("\t%" PRId64 "\t%" PRId64, verified, badVerify);
+		if (flushKind != FLUSH_NONE || flLat.count > 0) {
+			printf("\t%" PRId64, flLat.count);
+			printLatency("flush", &flLat, 1);
+		}
+		if (discardPct > 0 || dcLat.count > 0) {
+			printf("\t%" PRId64, dcLat.count);
+			printLatency("discard", &dcLat, 1);
+		}
+		putchar('\n');
+	} else {
+		printf("%.3lf secs, %"PRId64" IOs, %"PRId64" writes\n",
+		    secs, numio, numWrites);
+		printf("%.1lf IOs/sec, %.1lf MiB/s, %.3lf ms mean latency\n",
+		    numio / secs, bytes / 1048576.0 / secs,
+		    rdLat.count + wrLat.count == 0 ? 0.0 :
+		    (rdLat.sum + wrLat.sum) / 1e6 /
+		    (rdLat.count + wrLat.count));
+		if (flushKind != FLUSH_NONE || flLat.count > 0)
+			printf("%" PRId64 " flushes, %.1lf/sec\n",
+			    flLat.count, flLat.count / secs);
+		if (discardPct > 0 || dcLat.count > 0)
+			printf("%" PRId64 " discards, %.1lf/sec\n",
+			    dcLat.count, dcLat.count / secs);
+		if (rate > 0 && phases == NULL)
+			printf("Open loop, %.1lf IOs/sec target, %s arrivals; "
+			    "latency from intended issue time\n", rate,
+			    ratePoisson ? "poisson" : "fixed");
+		else if (trace != NULL)
+			printf("Trace replay, %" PRId64 " IOs, %s\n", ntrace,
+			    traceFast ? "as fast as possible" : "original "
+			    "timing; latency from intended issue time");
+		printf("%-10s %9s %9s", "latency ms", "min", "mean");
+		for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++) {
+			snprintf(label, sizeof(label), "p%g", pcts[i]);
+			printf(" %9s", label);
+		}
+		printf(" %9s\n", "max");
+		if (rdLat.count > 0)
+			printLatency("read", &rdLat, 0);
+		if (wrLat.count > 0)
+			printLatency("write", &wrLat, 0);
+		if (flLat.count > 0)
+			printLatency("flush", &flLat, 0);
+		if (dcLat.count > 0)
+			printLatency("discard", &dcLat, 0);
+		if (verify)
+			printf("%" PRId64 " reads verified, %" PRId64
+			    " failed\n", verified, badVerify);
+	}
+	if (phases != NULL)
+		printPhases(unformatted);
+	if (levels != NULL)
+		printSweep(unformatted);
+	if (cpus != NULL)
+		printPlacement(unformatted);
+	if (ntargets > 1) {
+		MYASSERT((labels = malloc(ntargets * sizeof(*labels))) != NULL,
+		    "malloc failed");
+		for (t = 0; t < ntargets; t++)
+			labels[t] = targets[t].name;
+		printBreakdown("target", (const char **)labels, wstats,
+		    ntargets, secs, unformatted);
+		free(labels);
+	}
+	if (sstats != NULL) {
+		MYASSERT((labels = malloc(nsizes * sizeof(*labels))) != NULL,
+		    "malloc failed");
+		for (k = 0; k < nsizes; k++) {
+			MYASSERT((labels[k] = malloc(24)) != NULL,
+			    "malloc failed");
+			if (unformatted || bsizes[k].size % 1024 != 0)
+				snprintf(labels[k], 24, "%ld", bsizes[k].size);
+			else if (bsizes[k].size % 1048576 != 0)
+				snprintf(labels[k], 24, "%ldk",
+				    bsizes[k].size / 1024);
+			else
+				snprintf(labels[k], 24, "%ldm",
+				    bsizes[k].size / 1048576);
+		}
+		printBreakdown("block size", (const char **)labels, sstats,
+		    nsizes, secs, unformatted);
+		for (k = 0; k < nsizes; k++)
+			free(labels[k]);
+		free(labels);
+	}
+	/* -u stays a line per result unless -v asks for more */
+	if (!unformatted || flVerbose) {
+		printGeometry(unformatted);
+		printDisks(unformatted);
+		printCpu(unformatted, secs);
+	}
+	exit(badVerify > 0);
+}
+
+/*
+ * runWorkers:
+ * Start the workers, wait for them to finish the run (or the phase of
+ * a job), and return how long they took.
+ */
+static double
+runWorkers(int flVerbose)
+{
+	struct timeval startTime, endTime;
+	struct cpuUse cpu0, cpu;
+	struct steady *st;
+	int64_t end;
+	int i;
+#ifdef USE_PTHREADS
+	pthread_t *tid, status_tid, sampler_tid, steady_tid;
+#else
+	char c;
+	int pfd[2];
+	pid_t *pid;
+	int64_t now, wake, logNext;
+	fd_set rdset;
+	struct timeval tmout;
+#endif
+
+	ctl->deadline = duration > 0 ? nanotime() + duration * 1e9 : 0;
+	st = curPhase != NULL && curPhase->steady.rounds > 0 ?
+	    &curPhase->steady : NULL;
+	if (logStart == 0)
+		logStart = nanotime();
+	diskSample(0);
+	cpuNow(&cpu0, 0, -1);
+
+#ifdef USE_PTHREADS
+	MYASSERT((tid = malloc(threads * sizeof(pthread_t))) != NULL,
 	    "malloc failed");
-	MYASSERT((pipe_cnt_w = (int *) malloc(threads * sizeof(int))) != NULL,
+#if HAVE_POSIX_MEMALIGN
+	if (posix_memalign((void **)&wcount, CACHE_LINE,
+	    threads * sizeof(*wcount)) != 0)
+		wcount = NULL;
+#else
+	wcount = malloc(threads * sizeof(*wcount));
+#endif
+	MYASSERT(wcount != NULL, "malloc failed");
+	memset(wcount, 0, threads * sizeof(*wcount));
+	ctl->pool = iolimit;
+	flFinished = 0;
+	for (i = 0; i < threads; i++) {
+		MYASSERT(pthread_create(&tid[i], NULL, &doIO,
+		    (void *)(intptr_t)i) == 0,
+		    "pthread_create failed");
+	}
+
+	MYASSERT(gettimeofday(&startTime, NULL) == 0, "gettimeofday failed");
+	if (st != NULL)
+		steadyStart(st);
+	if (flVerbose) {
+		MYASSERT(pthread_create(&status_tid, NULL, &status, NULL) == 0,
+		    "pthread_create failed");
+	}
+	if (logFile != NULL) {
+		MYASSERT(pthread_create(&sampler_tid, NULL, &sampler, NULL) ==
+		    0, "pthread_create failed");
+	}
+	if (st != NULL) {
+		MYASSERT(pthread_create(&steady_tid, NULL, &steadyWatch, st) ==
+		    0, "pthread_create failed");
+	}
+
+	/* wait for the threads to finish */
+	for (i = 0; i < threads; i++)
+		pthread_join(tid[i], NULL);
+	MYASSERT(gettimeofday(&endTime, NULL) == 0, "gettimeofday failed");
+	end = nanotime();
+	flFinished = 1;
+	numio = totalIO(&numWrites);
+	if (flVerbose)
+		pthread_join(status_tid, NULL);
+	if (logFile != NULL)
+		pthread_join(sampler_tid, NULL);
+	if (st != NULL)
+		pthread_join(steady_tid, NULL);
+	free(wcount);
+	free(tid);
+#else
+	MYASSERT((pid = malloc(threads * sizeof(pid_t))) != NULL,
 	    "malloc failed");
+	memset(wcount, 0, threads * sizeof(*wcount));
+	ctl->pool = iolimit;
+#if FIXED_SHARES
+	for (i = 0; i < threads; i++)
+		wcount[i].stash = iolimit / threads + (i < iolimit % threads);
+	ctl->pool = 0;
+#endif
+
+	/*
+	 * The children take their budget, and count their I/Os, in shared
+	 * memory, so the parent need only watch the clock.  Each holds the
+	 * write end of the pipe, so that it reads EOF as soon as the last
+	 * of them is done.
+	 */
+	MYASSERT(pipe(pfd) == 0, "pipe failed");
 	for (i = 0; i < threads; i++) {
-		MYASSERT(pipe((int *) &p) == 0, "pipe failed");
-		pipe_ctl_r[i] = p[0];
-		pipe_ctl_w[i] = p[1];
-		MYASSERT(pipe((int *) &p) == 0, "pipe failed");
-		pipe_cnt_r[i] = p[0];
-		pipe_cnt_w[i] = p[1];
 		switch (pid[i] = fork()) {
 		case -1:
 			perror("fork failed");
@@ -222,201 +1333,3282 @@ main(int argc, char **argv)
 			break;
 		case 0:		/* child */
 			signal(SIGINT, SIG_IGN);
-			close(pipe_ctl_w[i]);
-			close(pipe_cnt_r[i]);
-			doIO((void *)i);
+			close(pfd[0]);
+			doIO((void *)(intptr_t)i);
 			_exit(0);
 		default:	/* parent */
-			close(pipe_ctl_r[i]);
-			close(pipe_cnt_w[i]);
 			break;
 		}
-		
 	}
+	close(pfd[1]);
 
-	/* kick start all the children */
-	tok = 1;
-	fdmax = 0;
 	MYASSERT(gettimeofday(&startTime, NULL) == 0, "gettimeofday failed");
-	for (i = 0; i < threads && (iolimit == 0 ||
-	    numio < iolimit); i++) {
-		MYASSERT(write(pipe_ctl_w[i], &tok, 1) == 1,
-		    "write to pipe failed");	
-		if (fdmax < pipe_cnt_r[i])
-			fdmax = pipe_cnt_r[i];
-	}
-	fdmax++;
-	while ((iolimit == 0 || numio < iolimit) && !flAborted) {
+	logNext = nanotime() + logEvery;
+	if (st != NULL)
+		steadyStart(st);
+	while (!ATOMIC_LOAD(&flAborted) && !ATOMIC_LOAD(&ctl->aborted)) {
 		FD_ZERO(&rdset);
-		for (i = 0; i < threads; i++)
-			if (pipe_cnt_r[i] >= 0)
-				FD_SET(pipe_cnt_r[i], &rdset);
+		FD_SET(pfd[0], &rdset);
+		wake = flVerbose ? nanotime() + STATUS_UPDATE_TIME * 1000 :
+		    INT64_MAX;
+		if (logFile != NULL && logNext < wake)
+			wake = logNext;
+		if (st != NULL && st->next < wake)
+			wake = st->next;
 		tmout.tv_sec = 10;
 		tmout.tv_usec = 0;
-		switch(select(fdmax, &rdset, NULL, NULL, &tmout)) {
+		if ((now = nanotime()) > wake - 10000000000LL) {
+			now = now < wake ? wake - now : 0;
+			tmout.tv_sec = now / 1000000000;
+			tmout.tv_usec = now % 1000000000 / 1000;
+		}
+		switch (select(pfd[0] + 1, &rdset, NULL, NULL, &tmout)) {
 		case 0:
 			break;
 		case -1:
 			if (errno != EINTR) {
-				flAborted = 1;
+				ATOMIC_STORE(&flAborted, 1);
 				perror("select call failed");
-			}		/* fallthru */
+			}
+			break;
 		default:
-			for (i = 0; i < threads; i++)
-				if (pipe_cnt_r[i] >= 0 &&
-				    FD_ISSET(pipe_cnt_r[i], &rdset)) {
-					MYASSERT(read(pipe_cnt_r[i], &tok, 1)
-					    == 1,
-					    "read on count pipe failed");
-					numio++;
-					if (tok == 1)
-						numWrites++;
-					if (iolimit == 0 || numio +
-					    threads <= iolimit)
-						tok = 1;
-					else
-						tok = 0;
-					MYASSERT(write(pipe_ctl_w[i], &tok, 1)
-					    == 1,
-					    "write to control pipe failed");
-					if (tok == 0)
-						pipe_cnt_r[i] = -1;
-				}
+			if (read(pfd[0], &c, 1) == 0)
+				goto done;	/* all the children are done */
+			break;
+		}
+		if (logFile != NULL && (now = nanotime()) >= logNext) {
+			logSample(now, 0);
+			logNext += logEvery;
+			if (logNext <= now)
+				logNext = now + logEvery;
+		}
+		if (st != NULL && (now = nanotime()) >= st->next) {
+			if (steadyRound(st, now)) {
+				ATOMIC_STORE(&ctl->deadline, now);
+				st->next = INT64_MAX;
+			} else
+				st->next += st->round;
 		}
 		if (flVerbose)
-			statusLine(numio, iolimit, "IOs", "IO/s");
+			statusLine(totalIO(NULL), iolimit, "IOs", "IO/s");
 	}
-#endif
+done:
 	MYASSERT(gettimeofday(&endTime, NULL) == 0, "gettimeofday failed");
-	secs = endTime.tv_sec + endTime.tv_usec / 1000000.0
+	end = nanotime();
+	/* a child's error ends the run for all, as in the threaded build */
+	if (ATOMIC_LOAD(&ctl->aborted))
+		ATOMIC_STORE(&flAborted, 1);
+	for (i = 0; i < threads; i++) {
+		if (ATOMIC_LOAD(&flAborted))
+			kill(pid[i], SIGTERM);
+		while (waitpid(pid[i], NULL, 0) == -1 && errno == EINTR)
+			;
+	}
+	close(pfd[0]);
+	numio = totalIO(&numWrites);
+	free(pid);
+#endif
+	diskSample(1);
+	if (curPhase == NULL || curPhase->report) {
+		cpuNow(&cpu, 0, -1);
+		cpuAdd(&cpu, &cpu0, -1);
+		cpuAdd(&procCpu, &cpu, 1);
+		for (i = 0; i < threads; i++)
+			cpuAdd(&workCpu, &wcpu[i], 1);
+	}
+	if (logFile != NULL)
+		logSample(end, 1);
+	return endTime.tv_sec + endTime.tv_usec / 1000000.0
 	    - startTime.tv_sec - startTime.tv_usec / 1000000.0;
-	if (flAborted)
-		fprintf(stderr, "I/O aborted.\n");
+}
+
+/*
+ * runJob:
+ * Run the phases of a -j job in turn, in the one process so that no
+ * time is lost between them.  Each phase starts from the command line
+ * settings.  Only the results of phases with report set are counted,
+ * though verify failures always are; they are left in wstats for main
+ * to report, and the time taken is returned.
+ */
+static double
+runJob(const struct settings *base, int flVerbose)
+{
+	struct stats *mstats;
+	struct phase *ph;
+	int64_t ios, writes;
+	double secs;
+	int i;
+
+	MYASSERT((mstats = calloc(threads * ntargets, sizeof(*mstats))) !=
+	    NULL, "calloc failed");
+	secs = 0;
+	ios = writes = 0;
+	for (ph = phases; ph < phases + nphases && !ATOMIC_LOAD(&flAborted);
+	    ph++) {
+		applyPhase(ph, base);
+		curPhase = ph;
+		ph->secs = runWorkers(flVerbose);
+		curPhase = NULL;
+		for (i = 0; i < threads * ntargets; i++) {
+			histMerge(&ph->res.rd, &wstats[i].rd);
+			histMerge(&ph->res.wr, &wstats[i].wr);
+			ph->res.rdBytes += wstats[i].rdBytes;
+			ph->res.wrBytes += wstats[i].wrBytes;
+			mstats[i].verified += wstats[i].verified;
+			mstats[i].badVerify += wstats[i].badVerify;
+			if (!ph->report)
+				continue;
+			histMerge(&mstats[i].rd, &wstats[i].rd);
+			histMerge(&mstats[i].wr, &wstats[i].wr);
+			histMerge(&mstats[i].fl, &wstats[i].fl);
+			histMerge(&mstats[i].dc, &wstats[i].dc);
+			mstats[i].rdBytes += wstats[i].rdBytes;
+			mstats[i].wrBytes += wstats[i].wrBytes;
+		}
+		memset(wstats, 0, threads * ntargets * sizeof(*wstats));
+		if (ph->report) {
+			secs += ph->secs;
+			ios += numio;
+			writes += numWrites;
+		}
+	}
+	memcpy(wstats, mstats, threads * ntargets * sizeof(*wstats));
+	free(mstats);
+	numio = ios;
+	numWrites = writes;
+	restoreSettings(base);
+	return secs;
+}
+
+/*
+ * layout:
+ * Lay the blocks of the current block size out over the targets, and
+ * set up the access pattern over them.
+ */
+static void
+layout(void)
+{
+	int64_t minBlocks;
+	int k, t;
+
+	fileBlocks = minBlocks = 0;
+	for (t = 0; t < ntargets; t++) {
+		targets[t].blocks = (targets[t].size - ioOffset) / blockSize;
+		if (targets[t].size < maxBlockSize + ioOffset) {
+			fprintf(stderr, "Size %" PRId64 " of '%s' is smaller "
+			    "than the block size\n", targets[t].size,
+			    targets[t].name);
+			exit(1);
+		}
+		if (ioAlign > 0 && ioAlign % blockSize != 0 &&
+		    blockSize % ioAlign != 0) {
+			fprintf(stderr, "Alignment %ld and block size %ld "
+			    "must divide one another\n", ioAlign, blockSize);
+			exit(1);
+		}
+		if (targets[t].align > 0 && (ioAlign % targets[t].align != 0 ||
+		    ioOffset % targets[t].align != 0)) {
+			fprintf(stderr, "%s %" PRId64 " is not a multiple of "
+			    "the %ld byte direct I/O alignment of '%s'\n",
+			    ioAlign % targets[t].align != 0 ? "Alignment" :
+			    "Offset", ioAlign % targets[t].align != 0 ?
+			    (int64_t)ioAlign : ioOffset, targets[t].align,
+			    targets[t].name);
+			exit(1);
+		}
+		for (k = 0; targets[t].align > 0 && k < nsizes; k++) {
+			if (bsizes[k].size % targets[t].align == 0)
+				continue;
+			fprintf(stderr, "Block size %ld is not a multiple of "
+			    "the %ld byte direct I/O alignment of '%s'\n",
+			    bsizes[k].size, targets[t].align, targets[t].name);
+			exit(1);
+		}
+		targets[t].first = fileBlocks;
+		fileBlocks += targets[t].blocks;
+		if (t == 0 || targets[t].blocks < minBlocks)
+			minBlocks = targets[t].blocks;
+	}
+	/* striping uses the same number of blocks from every target */
+	if (spread == SPREAD_RR)
+		fileBlocks = minBlocks * ntargets;
+	patBlocks = verify ? fileBlocks / threads : fileBlocks;
+	patternInit();
+}
+
+/*
+ * readJob:
+ * Read a -j job file.  Each phase starts with a [name] line, followed
+ * by the settings it changes, one "key = value" to a line.  Blank lines
+ * and # comments are ignored.  The settings are checked by applyPhase().
+ */
+static void
+readJob(const char *file)
+{
+	struct phase *ph;
+	char line[1024], *p, *e, *val;
+	int lineno;
+	FILE *fp;
+
+	if ((fp = fopen(file, "r")) == NULL) {
+		fprintf(stderr, "Can't open '%s': %s\n", file,
+		    strerror(errno));
+		exit(1);
+	}
+	for (lineno = 1, ph = NULL; fgets(line, sizeof(line), fp) != NULL;
+	    lineno++) {
+		line[strcspn(line, "#\n")] = '\0';
+		for (p = line; isspace((int)*p); p++)
+			;
+		for (e = p + strlen(p); e > p && isspace((int)e[-1]); )
+			*--e = '\0';
+		if (*p == '\0')
+			continue;
+		if (*p == '[' && e[-1] == ']') {
+			e[-1] = '\0';
+			if (p[1] == '\0' || strlen(p + 1) >= sizeof(ph->name) ||
+			    p[1 + strspn(p + 1, "abcdefghijklmnopqrstuvwxyz"
+			    "ABCDEFGHIJKLMNOPQRSTUVWXYZ0123456789-_.")] !=
+			    '\0') {
+				fprintf(stderr, "%s:%d: invalid phase name\n",
+				    file, lineno);
+				exit(1);
+			}
+			phases = realloc(phases, (nphases + 1) *
+			    sizeof(*phases));
+			MYASSERT(phases != NULL, "malloc failed");
+			ph = &phases[nphases++];
+			memset(ph, 0, sizeof(*ph));
+			strcpy(ph->name, p + 1);
+			continue;
+		}
+		if (ph == NULL || (val = strchr(p, '=')) == NULL) {
+			fprintf(stderr, "%s:%d: expected [phase] or "
+			    "key = value\n", file, lineno);
+			exit(1);
+		}
+		if (ph->nkeys == PHASE_KEYS) {
+			fprintf(stderr, "%s:%d: too many settings\n", file,
+			    lineno);
+			exit(1);
+		}
+		for (e = val, *val++ = '\0'; e > p && isspace((int)e[-1]); )
+			*--e = '\0';
+		while (isspace((int)*val))
+			val++;
+		ph->key[ph->nkeys] = strdup(p);
+		ph->val[ph->nkeys] = strdup(val);
+		MYASSERT(ph->key[ph->nkeys] != NULL &&
+		    ph->val[ph->nkeys] != NULL, "malloc failed");
+		ph->nkeys++;
+	}
+	fclose(fp);
+	if (nphases == 0) {
+		fprintf(stderr, "No phases in '%s'\n", file);
+		exit(1);
+	}
+}
+
+static void
+saveSettings(struct settings *set)
+{
+	set->writePct = writePct;
+	set->discardPct = discardPct;
+	set->flushKind = flushKind;
+	set->flushEvery = flushEvery;
+	set->flushLim = flushLim;
+	set->iolimit = iolimit;
+	set->duration = duration;
+	set->rate = rate;
+	set->ratePoisson = ratePoisson;
+	memcpy(&set->pattern, &pattern, sizeof(pattern));
+	MYASSERT((set->bsizes = malloc(nsizes * sizeof(*bsizes))) != NULL,
+	    "malloc failed");
+	memcpy(set->bsizes, bsizes, nsizes * sizeof(*bsizes));
+	set->nsizes = nsizes;
+	set->blockSize = blockSize;
+	set->maxBlockSize = maxBlockSize;
+	set->sizeWeight = sizeWeight;
+}
+
+static void
+restoreSettings(const struct settings *set)
+{
+	writePct = set->writePct;
+	writeLim = (writePct << 10) / 100;
+	discardPct = set->discardPct;
+	discardLim = (discardPct << 10) / 100;
+	flushKind = set->flushKind;
+	flushEvery = set->flushEvery;
+	flushLim = set->flushLim;
+	iolimit = set->iolimit;
+	duration = set->duration;
+	rate = set->rate;
+	ratePoisson = set->ratePoisson;
+	memcpy(&pattern, &set->pattern, sizeof(pattern));
+	free(bsizes);
+	MYASSERT((bsizes = malloc(set->nsizes * sizeof(*bsizes))) != NULL,
+	    "malloc failed");
+	memcpy(bsizes, set->bsizes, set->nsizes * sizeof(*bsizes));
+	nsizes = set->nsizes;
+	blockSize = set->blockSize;
+	maxBlockSize = set->maxBlockSize;
+	sizeWeight = set->sizeWeight;
+	layout();
+}
+
+/*
+ * applyPhase:
+ * Make the settings of a phase current: those of the command line,
+ * changed by the phase's own.  count may be given as a multiple of the
+ * blocks of the target(s), such as 2x to write them all twice.
+ */
+static void
+applyPhase(struct phase *ph, const struct settings *base)
+{
+	char *key, *val, *p;
+	double times;
+	int i;
+
+	restoreSettings(base);
+	ph->report = 1;
+	ph->steady.rounds = 0;
+	for (i = 0, times = 0; i < ph->nkeys; i++) {
+		key = ph->key[i];
+		val = ph->val[i];
+		if (strcmp(key, "write") == 0) {
+			writePct = atoi(val);
+			if (writePct > 100)
+				writePct = 100;
+		} else if (strcmp(key, "discard") == 0) {
+			discardPct = atoi(val);
+			if (discardPct > 100)
+				discardPct = 100;
+		} else if (strcmp(key, "pattern") == 0)
+			parsePattern(val);
+		else if (strcmp(key, "flush") == 0)
+			parseFlush(val);
+		else if (strcmp(key, "bs") == 0 && !verify)
+			parseBlockSizes(val);
+		else if (strcmp(key, "count") == 0 && *val != '\0' &&
+		    val[strlen(val) - 1] == 'x') {
+			times = strtod(val, &p);
+			if (*p != 'x' || p[1] != '\0' || times <= 0) {
+				fprintf(stderr, "Invalid count: %s\n", val);
+				exit(1);
+			}
+		} else if (strcmp(key, "count") == 0) {
+			iolimit = getnum(val);
+			times = 0;
+		} else if (strcmp(key, "time") == 0) {
+			duration = getduration(val, &p);
+			if (*p != '\0' || duration < 0) {
+				fprintf(stderr, "Invalid duration: %s\n", val);
+				exit(1);
+			}
+		} else if (strcmp(key, "rate") == 0 && strcmp(val, "0") == 0)
+			rate = 0;
+		else if (strcmp(key, "rate") == 0)
+			parseRate(val);
+		else if (strcmp(key, "steady") == 0)
+			parseSteady(&ph->steady, ph->name, val);
+		else if (strcmp(key, "report") == 0 &&
+		    (strcmp(val, "yes") == 0 || strcmp(val, "no") == 0))
+			ph->report = strcmp(val, "yes") == 0;
+		else {
+			fprintf(stderr, "Phase '%s': invalid setting "
+			    "%s = %s%s\n", ph->name, key, val,
+			    strcmp(key, "bs") == 0 ?
+			    " (verify needs a single block size)" : "");
+			exit(1);
+		}
+	}
+	if (writePct + discardPct > 100) {
+		fprintf(stderr, "Phase '%s': write and discard percentages "
+		    "add up to more than 100\n", ph->name);
+		exit(1);
+	}
+	writeLim = (writePct << 10) / 100;
+	discardLim = (discardPct << 10) / 100;
+	layout();
+	if (times > 0)
+		iolimit = times * fileBlocks < 1 ? 1 : times * fileBlocks;
+}
+
+/*
+ * parseSteady:
+ * Parse a steady state criterion, metric:tolerance[:rounds x round],
+ * such as iops:20% or mibs:10%:5x1m.  The window defaults to five rounds
+ * of a minute, as in the SNIA PTS.
+ */
+static void
+parseSteady(struct steady *st, const char *phase, char *spec)
+{
+	char *p;
+
+	p = spec;
+	st->rounds = 5;
+	st->round = 60 * 1000000000LL;
+	if (strncmp(spec, "iops:", 5) == 0)
+		st->bytes = 0;
+	else if (strncmp(spec, "mibs:", 5) == 0)
+		st->bytes = 1;
+	else
+		st->rounds = 0;
+	if (st->rounds > 0) {
+		st->tolerance = strtod(spec + 5, &p) / 100;
+		if (*p == '%')
+			p++;
+		if (*p == ':') {
+			st->rounds = strtol(p + 1, &p, 10);
+			if (*p == 'x')
+				st->round = getduration(p + 1, &p) * 1e9;
+			else
+				st->round = 0;
+		}
+	}
+	if (st->rounds < 2 || st->round <= 0 || st->tolerance <= 0 ||
+	    *p != '\0') {
+		fprintf(stderr, "Phase '%s': invalid steady state: %s\n",
+		    phase, spec);
+		exit(1);
+	}
+	free(st->window);
+	MYASSERT((st->window = malloc(st->rounds * sizeof(*st->window))) !=
+	    NULL, "malloc failed");
+}
+
+static void
+steadyStart(struct steady *st)
+{
+	st->done = st->at = 0;
+	st->lastCount = 0;
+	st->lastTime = nanotime();
+	st->next = st->lastTime + st->round;
+}
+
+/*
+ * steadyRound:
+ * At the end of each round of a phase, add its IOs/sec (or MiB/s) to
+ * the window, and see whether the window is steady in the style of the
+ * SNIA PTS: its range within the tolerance of its average, and the rise
+ * or fall of its least squares fit across it within half that.  Returns
+ * 1 once it is.
+ */
+static int
+steadyRound(struct steady *st, int64_t now)
+{
+	double v, avg, min, max, x, sxx, sxy;
+	int64_t count;
+	int i, n;
+
+	count = statsTotal(st->bytes);
+	v = (count - st->lastCount) / ((now - st->lastTime) / 1e9);
+	st->lastCount = count;
+	st->lastTime = now;
+	st->window[st->done++ % st->rounds] = st->bytes ? v / 1048576.0 : v;
+	if (st->done < st->rounds)
+		return 0;
+	n = st->rounds;
+	avg = sxx = sxy = 0;
+	min = max = st->window[0];
+	for (i = 0; i < n; i++) {
+		/* oldest first */
+		v = st->window[(st->done + i) % n];
+		x = i - (n - 1) / 2.0;
+		avg += v;
+		sxx += x * x;
+		sxy += x * v;
+		if (v < min)
+			min = v;
+		if (v > max)
+			max = v;
+	}
+	avg /= n;
+	if (avg <= 0 || max - min > st->tolerance * avg ||
+	    fabs(sxy / sxx) * (n - 1) > st->tolerance / 2 * avg)
+		return 0;
+	st->at = st->done;
+	return 1;
+}
+
+/*
+ * statsTotal:
+ * IOs, or bytes, completed so far by all the workers.
+ */
+static int64_t
+statsTotal(int bytes)
+{
+	int64_t n;
+	int i;
+
+	for (i = 0, n = 0; i < threads * ntargets; i++)
+		n += bytes ? wstats[i].rdBytes + wstats[i].wrBytes :
+		    wstats[i].rd.count + wstats[i].wr.count;
+	return n;
+}
+
+/*
+ * printPhases:
+ * Results of each phase of a job.  Steady gives the rounds taken to
+ * reach the steady state, or "no" if it never was.  Unformatted, one
+ * line each: "phase", name, seconds, count, writes, rate, MiB/s, 1 if
+ * counted in the results, the rounds to steady state (0 with no
+ * criterion, -1 if never reached), then the read and write latencies as
+ * for the run as a whole.
+ */
+static void
+printPhases(int unformatted)
+{
+	struct histogram all;
+	struct phase *ph;
+	int64_t n;
+	char steady[16];
+
+	if (!unformatted)
+		printf("%-16s %9s %10s %10s %9s %9s %9s %6s %7s\n", "phase",
+		    "secs", "IOs", "IOs/sec", "MiB/s", "mean ms", "p99 ms",
+		    "steady", "counted");
+	for (ph = phases; ph < phases + nphases; ph++) {
+		n = ph->res.rd.count + ph->res.wr.count;
+		if (ph->steady.rounds == 0)
+			strcpy(steady, unformatted ? "0" : "-");
+		else if (ph->steady.at == 0)
+			strcpy(steady, unformatted ? "-1" : "no");
+		else
+			snprintf(steady, sizeof(steady), "%d", ph->steady.at);
+		if (unformatted) {
+			printf("phase\t%s\t%lf\t%" PRId64 "\t%" PRId64
+			    "\t%lf\t%lf\t%d\t%s", ph->name, ph->secs, n,
+			    ph->res.wr.count, ph->secs > 0 ? n / ph->secs : 0,
+			    ph->secs > 0 ? (ph->res.rdBytes +
+			    ph->res.wrBytes) / 1048576.0 / ph->secs : 0,
+			    ph->report, steady);
+			printLatency("read", &ph->res.rd, 1);
+			printLatency("write", &ph->res.wr, 1);
+			putchar('\n');
+			continue;
+		}
+		memcpy(&all, &ph->res.rd, sizeof(all));
+		histMerge(&all, &ph->res.wr);
+		printf("%-16s %9.3lf %10" PRId64 " %10.1lf %9.1lf %9.3lf "
+		    "%9.3lf %6s %7s\n", ph->name, ph->secs, n,
+		    ph->secs > 0 ? n / ph->secs : 0,
+		    ph->secs > 0 ? (ph->res.rdBytes + ph->res.wrBytes) /
+		    1048576.0 / ph->secs : 0,
+		    n ? (double)all.sum / n / 1e6 : 0.0,
+		    histPercentile(&all, 99) / 1e6, steady,
+		    ph->report ? "yes" : "no");
+	}
+}
+
+
+/*
+ * parseSweep:
+ * Parse -Q: the thread counts, or with q: the queue depths, to sweep,
+ * in increasing order, as a list such as 1,2,3,4,6,8 or as lo-hi for
+ * the powers of two between.  t: for threads may be given.
+ */
+static void
+parseSweep(char *spec)
+{
+	char *p, *q;
+	long lo, hi;
+
+	sweepDepth = strncmp(spec, "q:", 2) == 0;
+	p = sweepDepth || strncmp(spec, "t:", 2) == 0 ? spec + 2 : spec;
+	free(sweep);
+	sweep = NULL;
+	nsweep = 0;
+	for (;;) {
+		lo = hi = strtol(p, &q, 10);
+		if (*q == '-')
+			hi = strtol(q + 1, &q, 10);
+		if (q == p || lo <= 0 || hi < lo || (*q != ',' && *q != '\0') ||
+		    (nsweep > 0 && lo <= sweep[nsweep - 1])) {
+			fprintf(stderr, "Invalid sweep: %s\n", spec);
+			exit(1);
+		}
+		for (; lo <= hi; lo = lo * 2 > hi && lo < hi ? hi : lo * 2) {
+			sweep = realloc(sweep, (nsweep + 1) * sizeof(*sweep));
+			MYASSERT(sweep != NULL, "malloc failed");
+			sweep[nsweep++] = lo;
+		}
+		if (*q == '\0')
+			break;
+		p = q + 1;
+	}
+	free(levels);
+	MYASSERT((levels = calloc(nsweep, sizeof(*levels))) != NULL,
+	    "calloc failed");
+	for (lo = 0; lo < nsweep; lo++) {
+		snprintf(levels[lo].name, sizeof(levels[lo].name), "%c%d",
+		    sweepDepth ? 'q' : 't', sweep[lo]);
+		levels[lo].report = 1;
+	}
+}
+
+/*
+ * parseSlo:
+ * Parse -K, a latency target such as p99:1ms that the knee of a sweep
+ * must meet.
+ */
+static void
+parseSlo(char *spec)
+{
+	double t;
+	char *p;
+
+	if (*spec != 'p' || (sloPct = strtod(spec + 1, &p)) <= 0 ||
+	    sloPct >= 100 || *p != ':' ||
+	    (t = getduration(p + 1, &p)) <= 0 || *p != '\0') {
+		fprintf(stderr, "Invalid latency target: %s\n", spec);
+		exit(1);
+	}
+	sloLat = t * 1e9;
+}
+
+/*
+ * runSweep:
+ * Run at each level of a -Q sweep in turn, reads and writes counted
+ * together.  The results of every level are left in wstats, as for a
+ * job, and each level's in levels[].
+ */
+static double
+runSweep(int flVerbose)
+{
+	struct stats *mstats;
+	struct phase *lv;
+	int64_t ios, writes;
+	int i, max, n;
+	double secs;
+
+	max = threads;
+	n = max * ntargets;
+	MYASSERT((mstats = calloc(n, sizeof(*mstats))) != NULL,
+	    "calloc failed");
+	secs = 0;
+	ios = writes = 0;
+	for (lv = levels; lv < levels + nsweep && !ATOMIC_LOAD(&flAborted);
+	    lv++) {
+		if (sweepDepth)
+			qdepth = sweep[lv - levels];
+		else {
+			threads = sweep[lv - levels];
+			layout();
+		}
+		curPhase = lv;
+		lv->secs = runWorkers(flVerbose);
+		curPhase = NULL;
+		for (i = 0; i < n; i++) {
+			histMerge(&lv->res.rd, &wstats[i].rd);
+			histMerge(&lv->res.wr, &wstats[i].wr);
+			histMerge(&lv->res.fl, &wstats[i].fl);
+			histMerge(&lv->res.dc, &wstats[i].dc);
+			lv->res.rdBytes += wstats[i].rdBytes;
+			lv->res.wrBytes += wstats[i].wrBytes;
+			histMerge(&mstats[i].rd, &wstats[i].rd);
+			histMerge(&mstats[i].wr, &wstats[i].wr);
+			histMerge(&mstats[i].fl, &wstats[i].fl);
+			histMerge(&mstats[i].dc, &wstats[i].dc);
+			mstats[i].rdBytes += wstats[i].rdBytes;
+			mstats[i].wrBytes += wstats[i].wrBytes;
+		}
+		memset(wstats, 0, n * sizeof(*wstats));
+		secs += lv->secs;
+		ios += numio;
+		writes += numWrites;
+	}
+	memcpy(wstats, mstats, n * sizeof(*wstats));
+	free(mstats);
+	numio = ios;
+	numWrites = writes;
+	if (!sweepDepth) {
+		threads = max;
+		layout();
+	}
+	return secs;
+}
+
+/*
+ * printSweep:
+ * A line for each level of the sweep: its IOs/sec, MiB/s and latency,
+ * and whether it met the -K target.  The knee is the level with the
+ * most IOs/sec of those that met it, or, with no target, of them all.
+ */
+static void
+printSweep(int unformatted)
+{
+	struct histogram all;
+	struct phase *lv, *knee;
+	int64_t n, p;
+	double pct, iops;
+	int met;
+	char label[32];
+
+	pct = sloPct > 0 ? sloPct : 99;
+	snprintf(label, sizeof(label), "p%g ms", pct);
+	if (!unformatted)
+		printf("%7s %5s %9s %10s %10s %9s %9s %9s %9s %4s\n",
+		    "threads", "depth", "secs", "IOs", "IOs/sec", "MiB/s",
+		    "mean ms", label, "max ms", "met");
+	for (lv = levels, knee = NULL; lv < levels + nsweep; lv++) {
+		if (lv->secs <= 0)
+			continue;	/* not run, the sweep was aborted */
+		memcpy(&all, &lv->res.rd, sizeof(all));
+		histMerge(&all, &lv->res.wr);
+		n = all.count;
+		p = histPercentile(&all, pct);
+		iops = n / lv->secs;
+		met = sloPct == 0 || (n > 0 && p <= sloLat);
+		if (met && (knee == NULL ||
+		    iops > (knee->res.rd.count + knee->res.wr.count) /
+		    knee->secs))
+			knee = lv;
+		if (unformatted) {
+			printf("level\t%d\t%d\t%lf\t%" PRId64 "\t%" PRId64
+			    "\t%lf\t%lf\t%d",
+			    sweepDepth ? threads : sweep[lv - levels],
+			    sweepDepth ? sweep[lv - levels] : qdepth,
+			    lv->secs, n, lv->res.wr.count, iops,
+			    (lv->res.rdBytes + lv->res.wrBytes) / 1048576.0 /
+			    lv->secs, met);
+			printLatency("read", &lv->res.rd, 1);
+			printLatency("write", &lv->res.wr, 1);
+			putchar('\n');
+			continue;
+		}
+		printf("%7d %5d %9.3lf %10" PRId64 " %10.1lf %9.1lf %9.3lf "
+		    "%9.3lf %9.3lf %4s\n",
+		    sweepDepth ? threads : sweep[lv - levels],
+		    sweepDepth ? sweep[lv - levels] : qdepth,
+		    lv->secs, n, iops, (lv->res.rdBytes + lv->res.wrBytes) /
+		    1048576.0 / lv->secs, n ? (double)all.sum / n / 1e6 : 0.0,
+		    p / 1e6, all.max / 1e6,
+		    sloPct == 0 ? "-" : met ? "yes" : "no");
+	}
 	if (unformatted) {
-		printf("%"PRId64"\t%d\t%ld\t%d\t%"PRId64"\t%"PRId64"\t%lf\t%lf\n",
-		    fileSize,
-		    threads, blockSize, writePct, numio, numWrites, secs,
-		    numio / secs);
-	} else {
-		printf("%.3lf secs, %"PRId64" IOs, %"PRId64" writes\n",
-		    secs, numio, numWrites);
-		printf("%.1lf IOs/sec, %.2lf ms average seek\n", numio / secs,
-		    secs / numio * 1000.0);
+		printf("knee\t%d\t%d\n", knee == NULL ? 0 : sweepDepth ?
+		    threads : sweep[knee - levels], knee == NULL ? 0 :
+		    sweepDepth ? sweep[knee - levels] : qdepth);
+		return;
+	}
+	if (knee == NULL) {
+		printf("Knee: no level met p%g <= %.3lf ms\n", pct,
+		    sloLat / 1e6);
+		return;
+	}
+	memcpy(&all, &knee->res.rd, sizeof(all));
+	histMerge(&all, &knee->res.wr);
+	printf("Knee: %d threads, depth %d: %.1lf IOs/sec, p%g %.3lf ms",
+	    sweepDepth ? threads : sweep[knee - levels],
+	    sweepDepth ? sweep[knee - levels] : qdepth,
+	    all.count / knee->secs, pct, histPercentile(&all, pct) / 1e6);
+	if (sloPct > 0)
+		printf(" (target %.3lf ms)", sloLat / 1e6);
+	putchar('\n');
+}
+
+/*
+ * parseHeat:
+ * Parse -H: the heatmap file, optionally preceded by the number of
+ * regions to split each target into.
+ */
+static void
+parseHeat(char *spec)
+{
+	char *p;
+
+	heatRegions = 64;
+	heatName = spec;
+	if (isdigit((int)*spec)) {
+		heatRegions = strtol(spec, &p, 10);
+		if (*p != ':' || p[1] == '\0' || heatRegions <= 0 ||
+		    heatRegions > 1024) {
+			fprintf(stderr, "Invalid heatmap: %s\n", spec);
+			exit(1);
+		}
+		heatName = p + 1;
+	}
+}
+
+/*
+ * writeHeat:
+ * Write the -H heatmap: a CSV line for each region of each target, in
+ * order of offset, with the byte range it covers, its reads and writes
+ * and their latency together.  Slow regions of the target, such as
+ * remapped sectors, a degraded RAID member or an SMR zone being
+ * cleaned, stand out where a single figure for the whole target would
+ * hide them.
+ */
+static void
+writeHeat(void)
+{
+	struct histogram h;
+	struct region *r;
+	int64_t writes, end;
+	FILE *fp;
+	int t, k, i, j;
+
+	if ((fp = fopen(heatName, "w")) == NULL) {
+		fprintf(stderr, "Can't create '%s': %s\n", heatName,
+		    strerror(errno));
+		return;
+	}
+	fprintf(fp, "target,region,start,end,reads,writes,mean_ms");
+	for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+		fprintf(fp, ",p%g_ms", pcts[i]);
+	fprintf(fp, ",max_ms\n");
+	for (t = 0; t < ntargets; t++) {
+		for (k = 0; k < heatRegions; k++) {
+			memset(&h, 0, sizeof(h));
+			writes = 0;
+			for (j = 0; j < threads; j++) {
+				r = &heat[(j * ntargets + t) * heatRegions + k];
+				histMerge(&h, &r->lat);
+				writes += r->writes;
+			}
+			end = (k + 1) * targets[t].regionSize;
+			if (end > targets[t].size)
+				end = targets[t].size;
+			fprintf(fp, "%d,%d,%" PRId64 ",%" PRId64 ",%" PRId64
+			    ",%" PRId64 ",%.3lf", t, k,
+			    k * targets[t].regionSize, end, h.count - writes,
+			    writes, h.count ? (double)h.sum / h.count / 1e6 :
+			    0.0);
+			for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+				fprintf(fp, ",%.3lf",
+				    histPercentile(&h, pcts[i]) / 1e6);
+			fprintf(fp, ",%.3lf\n", h.max / 1e6);
+		}
+	}
+	if (fclose(fp) != 0)
+		fprintf(stderr, "Can't write '%s': %s\n", heatName,
+		    strerror(errno));
+}
+
+/*
+ * loadTrace:
+ * Read the -x trace, binary (as written by -X) or text.  Text is one
+ * I/O to a line: time in seconds, offset and size in bytes (with the
+ * usual multipliers, so 8s is 8 sectors), R or W, and optionally the
+ * target number, counting from 0.  Output of blkparse(1) is taken as it
+ * stands: the I/Os it shows issued to the driver (D) are replayed, less
+ * discards and flushes.  The records are sorted by time, and the first
+ * is at time 0.
+ */
+static void
+loadTrace(const char *spec)
+{
+	struct traceHeader hdr;
+	int64_t max;
+	size_t n;
+	FILE *fp;
+
+	traceFast = strncmp(spec, "fast:", 5) == 0;
+	if (traceFast)
+		spec += 5;
+	else if (strncmp(spec, "timed:", 6) == 0)
+		spec += 6;
+	if ((fp = fopen(spec, "r")) == NULL) {
+		fprintf(stderr, "Can't open '%s': %s\n", spec, strerror(errno));
+		exit(1);
+	}
+	n = fread(&hdr, 1, sizeof(hdr), fp);
+	if (n < sizeof(hdr) || memcmp(hdr.magic, TRACE_MAGIC,
+	    sizeof(hdr.magic)) != 0) {
+		rewind(fp);
+		traceText(fp, spec);
+	} else if (hdr.order != TRACE_ORDER) {
+		fprintf(stderr, "Trace '%s' is from a machine of the other "
+		    "byte order\n", spec);
+		exit(1);
+	} else {
+		for (max = 0; ; ntrace += n) {
+			if (ntrace == max) {
+				max = max ? max * 2 : 4096;
+				trace = realloc(trace, max * sizeof(*trace));
+				MYASSERT(trace != NULL, "malloc failed");
+			}
+			n = fread(trace + ntrace, sizeof(*trace), max - ntrace,
+			    fp);
+			if (n == 0)
+				break;
+		}
+	}
+	fclose(fp);
+	if (ntrace == 0) {
+		fprintf(stderr, "No I/Os in trace '%s'\n", spec);
+		exit(1);
+	}
+	qsort(trace, ntrace, sizeof(*trace), traceCmp);
+	for (max = ntrace - 1; max >= 0; max--)
+		trace[max].time -= trace[0].time;
+}
+
+static void
+traceText(FILE *fp, const char *name)
+{
+	struct traceRec r;
+	int64_t lineno, max;
+	char line[1024], *f[12], *p;
+	int n, blkparse;
+	double t;
+
+	for (lineno = 1, max = 0, blkparse = -1;
+	    fgets(line, sizeof(line), fp) != NULL; lineno++) {
+		line[strcspn(line, "#\n")] = '\0';
+		for (n = 0, p = strtok(line, " \t"); p != NULL && n < 12;
+		    p = strtok(NULL, " \t"))
+			f[n++] = p;
+		if (n == 0)
+			continue;
+		if (blkparse < 0)
+			blkparse = strchr(f[0], ',') != NULL;
+		memset(&r, 0, sizeof(r));
+		if (blkparse) {
+			/* dev cpu seq time pid action rwbs sector + count */
+			if (n < 10 || strcmp(f[5], "D") != 0 ||
+			    strcmp(f[8], "+") != 0 || atol(f[9]) <= 0 ||
+			    (!strchr(f[6], 'R') && !strchr(f[6], 'W') &&
+			    !strchr(f[6], 'D')))
+				continue;
+			t = strtod(f[3], NULL);
+			r.pos = strtoll(f[7], NULL, 10) * 512;
+			r.len = atol(f[9]) * 512;
+			r.discard = strchr(f[6], 'D') != NULL;
+			r.write = !r.discard && strchr(f[6], 'W') != NULL;
+		} else {
+			t = strtod(f[0], &p);
+			if (n < 4 || *p != '\0' || !isdigit((int)*f[1]) ||
+			    (f[3][0] != 'R' && f[3][0] != 'W' &&
+			    f[3][0] != 'D')) {
+				fprintf(stderr, "%s:%" PRId64 ": expected time "
+				    "offset size R|W|D [target]\n", name,
+				    lineno);
+				exit(1);
+			}
+			r.pos = getnum(f[1]);
+			r.len = getnum(f[2]);
+			r.write = f[3][0] == 'W';
+			r.discard = f[3][0] == 'D';
+			r.target = n > 4 ? atoi(f[4]) : 0;
+		}
+		if (t < 0 || r.len <= 0) {
+			fprintf(stderr, "%s:%" PRId64 ": invalid I/O\n", name,
+			    lineno);
+			exit(1);
+		}
+		r.time = t * 1e9;
+		if (ntrace == max) {
+			max = max ? max * 2 : 4096;
+			trace = realloc(trace, max * sizeof(*trace));
+			MYASSERT(trace != NULL, "malloc failed");
+		}
+		trace[ntrace++] = r;
+	}
+}
+
+static int
+traceCmp(const void *a, const void *b)
+{
+	const struct traceRec *ra = a, *rb = b;
+
+	return ra->time < rb->time ? -1 : ra->time > rb->time;
+}
+
+/*
+ * checkTrace:
+ * Every I/O of the trace must fit the targets, and their direct I/O
+ * alignment; buffers are sized for the largest.
+ */
+static void
+checkTrace(void)
+{
+	struct traceRec *r;
+	struct target *t;
+
+	for (r = trace; r < trace + ntrace; r++) {
+		if (r->target >= ntargets) {
+			fprintf(stderr, "Trace I/O %" PRId64 " is to target "
+			    "%d, but there are only %d\n",
+			    (int64_t)(r - trace), r->target, ntargets);
+			exit(1);
+		}
+		t = &targets[r->target];
+		if (r->pos + r->len > t->size) {
+			fprintf(stderr, "Trace I/O %" PRId64 " is beyond the "
+			    "end of '%s'\n", (int64_t)(r - trace), t->name);
+			exit(1);
+		}
+		if (t->align > 0 &&
+		    (r->pos % t->align != 0 || r->len % t->align != 0)) {
+			fprintf(stderr, "Trace I/O %" PRId64 " does not meet "
+			    "the %ld byte direct I/O alignment of '%s'\n",
+			    (int64_t)(r - trace), t->align, t->name);
+			exit(1);
+		}
+		if (r->len > maxBlockSize)
+			maxBlockSize = r->len;
+	}
+}
+
+/*
+ * traceReq:
+ * Fill in a request from a worker's next I/O of the trace.  Worker n
+ * replays the nth I/O, and every threads'th after it.
+ */
+static void
+traceReq(struct worker *w, struct ioreq *req)
+{
+	struct traceRec *r = &trace[w->rec];
+
+	req->size = 0;
+	req->len = r->len;
+	req->target = r->target;
+	req->fd = targets[r->target].fds[w->tid];
+	req->pos = r->pos;
+	req->block = req->pos / blockSize;
+	req->write = r->write;
+	req->discard = r->discard;
+	w->rec += threads;
+}
+
+/*
+ * traceRecord:
+ * Append an I/O as issued to a worker's -X file.
+ */
+static void
+traceRecord(FILE *fp, const struct ioreq *req)
+{
+	struct traceRec r;
+
+	memset(&r, 0, sizeof(r));
+	r.time = req->start - logStart;
+	r.pos = req->pos;
+	r.len = req->len;
+	r.target = req->target;
+	r.write = req->write;
+	r.discard = req->discard;
+	MYASSERT(fwrite(&r, sizeof(r), 1, fp) == 1, "trace write failed");
+}
+
+/*
+ * saveTrace:
+ * Merge the workers' -X files, each in time order, into the trace.  It
+ * is text, as read by -x, if the name ends in .txt, else binary.
+ */
+static void
+saveTrace(const char *name)
+{
+	struct traceHeader hdr;
+	struct traceRec *head;
+	int *live, i, j, text;
+	FILE *fp;
+
+	text = strlen(name) > 4 && strcmp(name + strlen(name) - 4, ".txt") == 0;
+	if ((fp = fopen(name, "w")) == NULL) {
+		fprintf(stderr, "Can't create '%s': %s\n", name,
+		    strerror(errno));
+		exit(1);
+	}
+	if (!text) {
+		memset(&hdr, 0, sizeof(hdr));
+		memcpy(hdr.magic, TRACE_MAGIC, sizeof(hdr.magic));
+		hdr.order = TRACE_ORDER;
+		hdr.version = 1;
+		MYASSERT(fwrite(&hdr, sizeof(hdr), 1, fp) == 1,
+		    "trace write failed");
+	}
+	head = malloc(threads * sizeof(*head));
+	live = malloc(threads * sizeof(*live));
+	MYASSERT(head != NULL && live != NULL, "malloc failed");
+	for (i = 0; i < threads; i++) {
+		fflush(recFiles[i]);
+		rewind(recFiles[i]);
+		live[i] = fread(&head[i], sizeof(*head), 1, recFiles[i]) == 1;
+	}
+	for (;;) {
+		for (i = 0, j = -1; i < threads; i++)
+			if (live[i] && (j < 0 || head[i].time < head[j].time))
+				j = i;
+		if (j < 0)
+			break;
+		if (text)
+			fprintf(fp, "%.9lf %" PRId64 " %u %c %u\n",
+			    head[j].time / 1e9, (int64_t)head[j].pos,
+			    head[j].len, head[j].discard ? 'D' :
+			    head[j].write ? 'W' : 'R',
+			    head[j].target);
+		else
+			MYASSERT(fwrite(&head[j], sizeof(*head), 1, fp) == 1,
+			    "trace write failed");
+		live[j] = fread(&head[j], sizeof(*head), 1, recFiles[j]) == 1;
+	}
+	MYASSERT(fclose(fp) == 0, "trace write failed");
+	for (i = 0; i < threads; i++)
+		fclose(recFiles[i]);
+	free(live);
+	free(head);
+}
+
+/*
+ * Latency histograms.  Log-linear, in the style of HdrHistogram: values
+ * (nanoseconds) below HIST_SUB are kept exactly, and each power of two
+ * above that is split into HIST_SUB linear buckets, so every value is
+ * recorded to within 1/HIST_SUB.
+ */
+static int
+msb64(uint64_t v)
+{
+#ifdef __GNUC__
+	return 63 - __builtin_clzll(v);
+#else
+	int n;
+
+	for (n = 0; v >>= 1; n++)
+		;
+	return n;
+#endif
+}
+
+static void
+histRecord(struct histogram *h, int64_t v)
+{
+	int e, idx;
+
+	if (v < 0)
+		v = 0;
+	if (v < HIST_SUB)
+		idx = v;
+	else {
+		e = msb64(v) - HIST_SUB_BITS;
+		idx = (e + 1) * HIST_SUB + (int)(v >> e) - HIST_SUB;
+		if (idx >= HIST_BUCKETS)
+			idx = HIST_BUCKETS - 1;
+	}
+	h->bucket[idx]++;
+	if (h->count == 0 || v < h->min)
+		h->min = v;
+	if (v > h->max)
+		h->max = v;
+	h->count++;
+	h->sum += v;
+}
+
+/*
+ * Midpoint of a bucket.
+ */
+static int64_t
+histValue(int idx)
+{
+	int shift;
+
+	if (idx < HIST_SUB)
+		return idx;
+	shift = idx / HIST_SUB - 1;
+	return ((int64_t)(HIST_SUB + idx % HIST_SUB) << shift) +
+	    ((int64_t)1 << shift) / 2;
+}
+
+static void
+histMerge(struct histogram *dst, const struct histogram *src)
+{
+	int i;
+
+	if (src->count == 0)
+		return;
+	if (dst->count == 0 || src->min < dst->min)
+		dst->min = src->min;
+	if (src->max > dst->max)
+		dst->max = src->max;
+	dst->count += src->count;
+	dst->sum += src->sum;
+	for (i = 0; i < HIST_BUCKETS; i++)
+		dst->bucket[i] += src->bucket[i];
+}
+
+static int64_t
+histPercentile(const struct histogram *h, double pct)
+{
+	int64_t want, seen, v;
+	int i;
+
+	if (h->count == 0)
+		return 0;
+	want = ceil(h->count * pct / 100.0);
+	if (want < 1)
+		want = 1;
+	for (i = 0, seen = 0; i < HIST_BUCKETS - 1; i++) {
+		seen += h->bucket[i];
+		if (seen >= want)
+			break;
+	}
+	v = histValue(i);
+	if (v < h->min)
+		v = h->min;
+	if (v > h->max)
+		v = h->max;
+	return v;
+}
+
+/*
+ * printLatency:
+ * Print min, mean, the percentiles and max of a histogram, in ms.
+ * Unformatted output is tab separated with a leading tab.
+ */
+static void
+printLatency(const char *label, const struct histogram *h, int unformatted)
+{
+	int i;
+
+	if (unformatted)
+		printf("\t%lf\t%lf", h->min / 1e6,
+		    h->count ? (double)h->sum / h->count / 1e6 : 0.0);
+	else
+		printf("%-10s %9.3lf %9.3lf", label, h->min / 1e6,
+		    h->count ? (double)h->sum / h->count / 1e6 : 0.0);
+	for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++)
+		printf(unformatted ? "\t%lf" : " %9.3lf",
+		    histPercentile(h, pcts[i]) / 1e6);
+	printf(unformatted ? "\t%lf" : " %9.3lf\n", h->max / 1e6);
+}
+
+/*
+ * histDiff:
+ * The values recorded in a since b, a later copy of the same histogram.
+ * Min and max are only known to within a bucket.
+ */
+static void
+histDiff(struct histogram *dst, const struct histogram *a,
+    const struct histogram *b)
+{
+	int i;
+
+	memset(dst, 0, sizeof(*dst));
+	for (i = 0; i < HIST_BUCKETS; i++) {
+		if ((dst->bucket[i] = a->bucket[i] - b->bucket[i]) == 0)
+			continue;
+		if (dst->count == 0)
+			dst->min = histValue(i);
+		dst->max = histValue(i);
+		dst->count += dst->bucket[i];
+	}
+	dst->sum = a->sum - b->sum;
+}
+
+/*
+ * logSample:
+ * Append a record for the interval ending at now to the -o log: for
+ * reads and writes, IOs/sec, MiB/s and latency.  The workers' results
+ * are only ever added to, so the interval is the difference between
+ * their totals now and at the last sample, and costs the workers
+ * nothing.  The totals are read as the workers update them, so a
+ * record may be out by an I/O or two.  The last, partial, interval of
+ * a run, or of a phase of a job, is left out if nothing completed in it.
+ */
+static void
+logSample(int64_t now, int last)
+{
+	static struct histogram prev[2];
+	static int64_t prevBytes[2], prevTime, lines;
+	static const char *dir[] = { "read", "write" };
+	struct histogram cur[2], h;
+	struct disk *d;
+	int64_t bytes[2];
+	double secs, ms;
+	int header, i, j;
+	char name[32];
+
+	if (prevTime == 0)
+		prevTime = logStart;
+	if ((secs = (now - prevTime) / 1e9) <= 0 && !last)
+		return;
+	memset(cur, 0, sizeof(cur));
+	bytes[0] = bytes[1] = 0;
+	for (i = 0; i < threads * ntargets; i++) {
+		histMerge(&cur[0], &wstats[i].rd);
+		histMerge(&cur[1], &wstats[i].wr);
+		bytes[0] += wstats[i].rdBytes;
+		bytes[1] += wstats[i].wrBytes;
+	}
+	for (d = disks; d < disks + ndisks; d++)
+		if (diskRead(d, d->cur) != 0)
+			memcpy(d->cur, d->prev, sizeof(d->cur));
+	/* a CSV log starts with a line of column names */
+	header = lines == 0 && !logJSON;
+	if (secs <= 0 || (last && lines > 0 &&
+	    cur[0].count + cur[1].count == prev[0].count + prev[1].count))
+		header = -1;
+	for (; header >= 0; header--) {
+		lines++;
+		logField(NULL, "time", (now - logStart) / 1e9, header);
+		if (curPhase != NULL && logJSON)
+			fprintf(logFile, ",\"phase\":\"%s\"", curPhase->name);
+		else if (curPhase != NULL)
+			fprintf(logFile, ",%s",
+			    header ? "phase" : curPhase->name);
+		for (j = 0; j < 2; j++) {
+			histDiff(&h, &cur[j], &prev[j]);
+			logField(dir[j], "iops", h.count / secs, header);
+			logField(dir[j], "mibs",
+			    (bytes[j] - prevBytes[j]) / 1048576.0 / secs,
+			    header);
+			logField(dir[j], "mean_ms", h.count ?
+			    (double)h.sum / h.count / 1e6 : 0.0, header);
+			for (i = 0; i < sizeof(pcts) / sizeof(pcts[0]); i++) {
+				snprintf(name, sizeof(name), "p%g_ms", pcts[i]);
+				logField(dir[j], name,
+				    histPercentile(&h, pcts[i]) / 1e6, header);
+			}
+			logField(dir[j], "max_ms", h.max / 1e6, header);
+		}
+		for (d = disks; d < disks + ndisks; d++) {
+			ms = (now - d->prevTime) / 1e6;
+			logField(d->name, "util", ms <= 0 ? 0.0 :
+			    (d->cur[DS_BUSYMS] - d->prev[DS_BUSYMS]) * 100 / ms,
+			    header);
+			logField(d->name, "queue", ms <= 0 ? 0.0 :
+			    (d->cur[DS_QUEUEMS] - d->prev[DS_QUEUEMS]) / ms,
+			    header);
+		}
+		fputs(logJSON ? "}\n" : "\n", logFile);
+	}
+	fflush(logFile);
+	/* after the last sample of a job's phase, the results start over */
+	if (last)
+		memset(cur, 0, sizeof(cur));
+	memcpy(prev, cur, sizeof(prev));
+	prevBytes[0] = last ? 0 : bytes[0];
+	prevBytes[1] = last ? 0 : bytes[1];
+	prevTime = now;
+	for (d = disks; d < disks + ndisks; d++) {
+		memcpy(d->prev, d->cur, sizeof(d->prev));
+		d->prevTime = now;
+	}
+}
+
+/*
+ * logField:
+ * One field of a log record, or its name in the CSV header.  "time"
+ * starts each line.
+ */
+static void
+logField(const char *dir, const char *name, double v, int header)
+{
+	int first;
+
+	first = dir == NULL;
+	if (logJSON)
+		fprintf(logFile, "%s\"%s%s%s\":%.3lf", first ? "{" : ",",
+		    first ? "" : dir, first ? "" : "_", name, v);
+	else if (header)
+		fprintf(logFile, "%s%s%s%s", first ? "" : ",",
+		    first ? "" : dir, first ? "" : "_", name);
+	else
+		fprintf(logFile, "%s%.3lf", first ? "" : ",", v);
+}
+
+/*
+ * printBreakdown:
+ * Results per target or per block size: row j sums st[w * n + j] over
+ * the workers w.  Unformatted, one line each: label, count, writes,
+ * rate and MiB/s, then the read and write latencies as for the run as
+ * a whole.
+ */
+static void
+printBreakdown(const char *heading, const char **labels,
+    const struct stats *st, int n, double secs, int unformatted)
+{
+	struct histogram rd, wr, all;
+	int64_t bytes;
+	int i, j;
+
+	if (!unformatted)
+		printf("%-24s %10s %10s %9s %9s %9s %9s\n", heading, "IOs",
+		    "IOs/sec", "MiB/s", "mean ms", "p99 ms", "max ms");
+	for (j = 0; j < n; j++) {
+		memset(&rd, 0, sizeof(rd));
+		memset(&wr, 0, sizeof(wr));
+		for (i = 0, bytes = 0; i < threads; i++) {
+			histMerge(&rd, &st[i * n + j].rd);
+			histMerge(&wr, &st[i * n + j].wr);
+			bytes += st[i * n + j].rdBytes + st[i * n + j].wrBytes;
+		}
+		if (unformatted) {
+			printf("%s\t%" PRId64 "\t%" PRId64 "\t%lf\t%lf",
+			    labels[j], rd.count + wr.count, wr.count,
+			    (rd.count + wr.count) / secs,
+			    bytes / 1048576.0 / secs);
+			printLatency("read", &rd, 1);
+			printLatency("write", &wr, 1);
+			putchar('\n');
+			continue;
+		}
+		memcpy(&all, &rd, sizeof(all));
+		histMerge(&all, &wr);
+		printf("%-24s %10" PRId64 " %10.1lf %9.1lf %9.3lf %9.3lf "
+		    "%9.3lf\n", labels[j], all.count, all.count / secs,
+		    bytes / 1048576.0 / secs,
+		    all.count ? (double)all.sum / all.count / 1e6 : 0.0,
+		    histPercentile(&all, 99) / 1e6, all.max / 1e6);
+	}
+}
+
+#if !FIXED_SHARES
+/*
+ * claim:
+ * Take up to 'want' I/Os from the -c budget, returning the number
+ * granted.  A worker serves itself from its own stash, refilled from
+ * the shared pool in chunks that shrink as the pool runs down.  Once
+ * the pool is empty, a worker steals half of another's stash, so the
+ * last I/Os go to whoever is free and the budget is issued exactly.
+ */
+static int64_t
+claim(int tid, int64_t want)
+{
+	struct counters *c = &wcount[tid];
+	int64_t have, take, got;
+	int i, j;
+
+	if (ATOMIC_LOAD(&flAborted) || ATOMIC_LOAD(&ctl->aborted))
+		return 0;
+	if (iolimit == 0)
+		return want;
+	for (got = 0; got < want; ) {
+		have = ATOMIC_LOAD(&c->stash);
+		if (have > 0) {
+			take = have < want - got ? have : want - got;
+			if (ATOMIC_CAS(&c->stash, have, have - take))
+				got += take;
+			continue;
+		}
+		have = ATOMIC_LOAD(&ctl->pool);
+		if (have > 0) {
+			take = have / (2 * threads);
+			if (take > BUDGET_CHUNK)
+				take = BUDGET_CHUNK;
+			if (take < want - got)
+				take = want - got;
+			if (take > have)
+				take = have;
+			if (ATOMIC_CAS(&ctl->pool, have, have - take))
+				ATOMIC_ADD(&c->stash, take);
+			continue;
+		}
+		for (i = 1; i < threads; i++) {
+			j = (tid + i) % threads;
+			have = ATOMIC_LOAD(&wcount[j].stash);
+			take = (have + 1) / 2;
+			if (have > 0 &&
+			    ATOMIC_CAS(&wcount[j].stash, have, have - take)) {
+				ATOMIC_ADD(&c->stash, take);
+				break;
+			}
+		}
+		if (i == threads)
+			break;		/* budget all issued */
+	}
+	return got;
+}
+#else
+/*
+ * claim:
+ * Without atomic operations, each worker process is handed its share of
+ * the -c budget at the start, and takes only from that.
+ */
+static int64_t
+claim(int tid, int64_t want)
+{
+	struct counters *c = &wcount[tid];
+	int64_t got;
+
+	if (ATOMIC_LOAD(&flAborted) || ATOMIC_LOAD(&ctl->aborted))
+		return 0;
+	if (iolimit == 0)
+		return want;
+	got = c->stash < want ? c->stash : want;
+	c->stash -= got;
+	return got;
+}
+#endif
+
+/*
+ * totalIO:
+ * Sum the per-worker counters.
+ */
+static int64_t
+totalIO(int64_t *writes)
+{
+	int64_t n, w;
+	int i;
+
+	for (i = 0, n = w = 0; i < threads; i++) {
+		n += ATOMIC_LOAD(&wcount[i].numio);
+		w += ATOMIC_LOAD(&wcount[i].numWrites);
+	}
+	if (writes != NULL)
+		*writes = w;
+	return n;
+}
+
+#if defined(USE_PTHREADS) && !HAVE_ATOMIC_BUILTINS
+static int64_t
+atomicAdd(int64_t *p, int64_t v)
+{
+	MYASSERT(pthread_mutex_lock(&lock) == 0,
+	    "pthread_mutex_lock failed");
+	v = *p += v;
+	MYASSERT(pthread_mutex_unlock(&lock) == 0,
+	    "pthread_mutex_unlock failed");
+	return v;
+}
+
+static int
+atomicCas(int64_t *p, int64_t o, int64_t n)
+{
+	int ret;
+
+	MYASSERT(pthread_mutex_lock(&lock) == 0,
+	    "pthread_mutex_lock failed");
+	if ((ret = *p == o))
+		*p = n;
+	MYASSERT(pthread_mutex_unlock(&lock) == 0,
+	    "pthread_mutex_unlock failed");
+	return ret;
+}
+#endif
+
+/*
+ * doIO:
+ * Worker.  Keeps up to qdepth requests queued on the engine, and
+ * tops the queue up again after each batch of completions.  Open loop
+ * (-R), each I/O also waits for its arrival time, and its latency is
+ * counted from then rather than from when a queue slot came free, so
+ * that time spent queued behind a slow device is not hidden.
+ */
+static void *
+doIO(void *arg)
+{
+	int i, n, nfree, writes, finished, paced, op;
+	int64_t lat;
+	int64_t want, now, until, b, deadline;
+	struct stats *st, *sst;
+	struct region *hr;
+	struct worker w;
+	struct counters *ctr;
+	struct ioreq *req, **freeReqs;
+	struct cpuUse cpu0;
+	char *bufs;
+
+	memset(&w, 0, sizeof(w));
+	w.tid = (intptr_t)arg;
+	w.rec = w.tid;
+	w.next = verify ? 0 : fileBlocks / threads * w.tid;
+	st = &wstats[w.tid * ntargets];
+	sst = sstats != NULL ? &sstats[w.tid * nsizes] : NULL;
+	/* the regions of each target, unless in an uncounted phase */
+	hr = heat != NULL && (curPhase == NULL || curPhase->report) ?
+	    &heat[w.tid * ntargets * heatRegions] : NULL;
+#if HAVE_AFFINITY
+	if (placement != NULL &&
+	    sched_setaffinity(0, sizeof(cpu_set_t), &placement[w.tid]) != 0) {
+		perror("sched_setaffinity failed");
+		exit(1);
+	}
+#endif
+#if HAVE_POSIX_MEMALIGN
+	if (posix_memalign((void **)&bufs, bufAlign,
+	    (size_t)maxBlockSize * qdepth) != 0)
+		bufs = NULL;
+#else
+	bufs = malloc((size_t)maxBlockSize * qdepth);
+#endif
+	if (bufs == NULL ||
+	    (w.reqs = malloc(qdepth * sizeof(*w.reqs))) == NULL ||
+	    (w.done = malloc(qdepth * sizeof(*w.done))) == NULL ||
+	    (freeReqs = malloc(qdepth * sizeof(*freeReqs))) == NULL) {
+		fprintf(stderr, "malloc for %d queue slots failed.\n", qdepth);
+		exit(1);
+	}
+	/* fault the buffers in here, so they are local to this worker */
+	memset(bufs, 0, (size_t)maxBlockSize * qdepth);
+	for (i = 0; i < qdepth; i++) {
+		w.reqs[i].buf = bufs + (size_t)i * maxBlockSize;
+		w.reqs[i].block = -1;
+		freeReqs[i] = &w.reqs[i];
+	}
+	nfree = qdepth;
+	if (engine->init != NULL)
+		engine->init(&w);
+
+	rngSeed(&w);
+	w.dataSeed = rngNext(&w);
+	paced = rate > 0 || (trace != NULL && !traceFast);
+	if (rate > 0) {
+		/* fixed arrivals are staggered across the workers */
+		w.due = nanotime() + (ratePoisson ? interArrival(&w) :
+		    interArrival(&w) * w.tid / threads);
+	} else if (paced && w.rec < ntrace)
+		w.due = logStart + trace[w.rec].time;
+
+	w.perfFd = -1;
+	if (countCycles)
+		MYASSERT((w.perfFd = perfOpen()) >= 0,
+		    "perf_event_open failed");
+	cpuNow(&cpu0, 1, w.perfFd);
+
+	ctr = &wcount[w.tid];
+	want = claim(w.tid, nfree);
+	finished = want < nfree;
+	for (;;) {
+		for (; want > 0; want--) {
+			if (w.flushDue || (paced && w.due > nanotime()))
+				break;
+			if (trace != NULL && w.rec >= ntrace) {
+				finished = 1;	/* its share is done */
+				want = 0;
+				break;
+			}
+			req = freeReqs[--nfree];
+			if (trace != NULL)
+				traceReq(&w, req);
+			else {
+				req->size = pickSize(&w);
+				req->len = bsizes[req->size].size;
+				do {
+					b = nextBlock(&w, req->len / blockSize);
+					if (verify)
+						b += w.tid * patBlocks;
+				} while (verify && reqBusy(&w, b));
+				req->block = b;
+				req->target = mapBlock(&b);
+				req->fd = targets[req->target].fds[w.tid];
+				req->pos = blockPos(&w, b, req->len,
+				    req->target);
+				/* one draw picks read, write or discard */
+				op = rngNext(&w) >> 54;
+				req->write = op < writeLim;
+				req->discard = !req->write &&
+				    op < writeLim + discardLim;
+			}
+			if (req->write) {
+				initblock_r(req->buf, req->len, type, 1,
+				    &w.dataSeed);
+				if (verify)
+					verifyStamp(&w, req);
+			}
+			if (rate > 0) {
+				req->start = w.due;
+				w.due += interArrival(&w);
+			} else if (paced) {
+				req->start = w.due;
+				if (w.rec < ntrace)
+					w.due = logStart + trace[w.rec].time;
+			} else
+				req->start = nanotime();
+			if (recFiles != NULL)
+				traceRecord(recFiles[w.tid], req);
+			if (req->write && flushKind != FLUSH_NONE &&
+			    (flushEvery > 0 ? ++w.writes % flushEvery == 0 :
+			    (rngNext(&w) >> 54) < flushLim)) {
+				w.flush = *req;
+				w.flushDue = 1;
+			}
+			engine->submit(&w, req);
+			w.inflight++;
+		}
+		if (w.flushDue && w.inflight == 0) {
+			/* as a commit, once the writes before it are done */
+			if (flushIO(&w, st) != 0 && !ignore) {
+				ATOMIC_STORE(&flAborted, 1);
+				ATOMIC_STORE(&ctl->aborted, 1);
+				finished = 1;
+				want = 0;
+			}
+			continue;
+		}
+		if (w.inflight == 0 && want == 0)
+			break;
+
+		if (w.inflight == 0) {
+			/* open loop, with nothing due until the next arrival */
+			until = w.due;
+			deadline = ATOMIC_LOAD(&ctl->deadline);
+			if (deadline != 0 && deadline < until)
+				until = deadline;
+			now = sleepUntil(until);
+			n = 0;
+		} else {
+			w.wake = want > 0 && !w.flushDue ? w.due : 0;
+			n = engine->reap(&w);
+			now = nanotime();
+		}
+		for (i = writes = 0; i < n; i++) {
+			req = w.done[i];
+			lat = now - req->start;
+			histRecord(req->discard ? &st[req->target].dc :
+			    req->write ? &st[req->target].wr :
+			    &st[req->target].rd, lat);
+			if (sst != NULL)
+				histRecord(req->discard ? &sst[req->size].dc :
+				    req->write ? &sst[req->size].wr :
+				    &sst[req->size].rd, lat);
+			if (hr != NULL && !req->discard) {
+				b = req->target * heatRegions + req->pos /
+				    targets[req->target].regionSize;
+				histRecord(&hr[b].lat, lat);
+				hr[b].writes += req->write;
+			}
+			if (req->ret > 0 && req->write) {
+				st[req->target].wrBytes += req->ret;
+				if (sst != NULL)
+					sst[req->size].wrBytes += req->ret;
+			} else if (req->ret > 0 && !req->discard) {
+				st[req->target].rdBytes += req->ret;
+				if (sst != NULL)
+					sst[req->size].rdBytes += req->ret;
+			}
+			if (req->ret < 0) {
+				fprintf(stderr, "%s I/O failed on '%s', "
+				    "offset %" PRId64 ": %d (%s)\n",
+				    req->discard ? "discard" :
+				    req->write ? "write" : "read",
+				    targets[req->target].name,
+				    (int64_t)req->pos, (int)-req->ret,
+				    strerror(-req->ret));
+				if (!ignore) {
+					ATOMIC_STORE(&flAborted, 1);
+					ATOMIC_STORE(&ctl->aborted, 1);
+					finished = 1;
+					want = 0;
+				}
+			} else if (req->ret < req->len) {
+				fprintf(stderr, "short %s I/O on '%s', "
+				    "offset %" PRId64 ", %" PRId64 " bytes\n",
+				    req->discard ? "discard" :
+				    req->write ? "write" : "read",
+				    targets[req->target].name,
+				    (int64_t)req->pos, (int64_t)req->ret);
+			}
+			if (verify && verifyCheck(&w, req,
+			    &st[req->target]) != 0 && !ignore) {
+				ATOMIC_STORE(&flAborted, 1);
+				ATOMIC_STORE(&ctl->aborted, 1);
+				finished = 1;
+				want = 0;
+			}
+			req->block = -1;
+			writes += req->write;
+			freeReqs[nfree++] = req;
+			w.inflight--;
+		}
+		ATOMIC_STORE(&ctr->numWrites, ctr->numWrites + writes);
+		ATOMIC_STORE(&ctr->numio, ctr->numio + n);
+		deadline = ATOMIC_LOAD(&ctl->deadline);
+		if (ATOMIC_LOAD(&flAborted) || ATOMIC_LOAD(&ctl->aborted) ||
+		    (deadline != 0 && now >= deadline)) {
+			finished = 1;
+			want = 0;
+		}
+		/* budget claimed but not yet due is kept in want */
+		if (!finished)
+			want += claim(w.tid, nfree - want);
+		if (want < nfree)
+			finished = 1;
+	}
+	cpuNow(&wcpu[w.tid], 1, w.perfFd);
+	cpuAdd(&wcpu[w.tid], &cpu0, -1);
+	if (w.perfFd >= 0)
+		close(w.perfFd);
+	if (engine->fini != NULL)
+		engine->fini(&w);
+	if (recFiles != NULL)
+		MYASSERT(fflush(recFiles[w.tid]) == 0, "trace write failed");
+	free(freeReqs);
+	free(w.done);
+	free(w.reqs);
+	free(bufs);
+	return NULL;
+}
+
+/*
+ * Synchronous engines complete the I/O inside submit(), and just
+ * hand it back from reap().
+ */
+static void
+syncDone(struct worker *w, struct ioreq *req, ssize_t ret)
+{
+	req->ret = ret < 0 ? -errno : ret;
+	w->done[w->ndone++] = req;
+}
+
+static int
+syncReap(struct worker *w)
+{
+	int n;
+
+	n = w->ndone;
+	w->ndone = 0;
+	return n;
+}
+
+static void
+syncSubmit(struct worker *w, struct ioreq *req)
+{
+	if (req->discard) {
+		syncDone(w, req, discardRange(req));
+		return;
+	}
+	if (lseek(req->fd, req->pos, SEEK_SET) == -1) {
+		perror("lseek failed");
+		exit(1);
+	}
+	if (req->write)
+		syncDone(w, req, write(req->fd, req->buf, req->len));
+	else
+		syncDone(w, req, read(req->fd, req->buf, req->len));
+}
+
+#if HAVE_PREAD && HAVE_PWRITE
+static void
+psyncSubmit(struct worker *w, struct ioreq *req)
+{
+	if (req->discard)
+		syncDone(w, req, discardRange(req));
+	else if (req->write)
+		syncDone(w, req, pwrite(req->fd, req->buf, req->len, req->pos));
+	else
+		syncDone(w, req, pread(req->fd, req->buf, req->len, req->pos));
+}
+#endif
+
+#if HAVE_PREADV && HAVE_PWRITEV
+/*
+ * Scatter/gather the buffer a page at a time, as a database reading
+ * into its page cache would.
+ */
+#define VSYNC_SEGMENT	4096
+
+static void
+vsyncSubmit(struct worker *w, struct ioreq *req)
+{
+	struct iovec iov[IOV_MAX];
+	long seg, off;
+	int n;
+
+	seg = VSYNC_SEGMENT;
+	if (req->len > seg * IOV_MAX)
+		seg = (req->len + IOV_MAX - 1) / IOV_MAX;
+	for (n = 0, off = 0; off < req->len; n++, off += seg) {
+		iov[n].iov_base = req->buf + off;
+		iov[n].iov_len = req->len - off < seg ? req->len - off : seg;
+	}
+	if (req->discard)
+		syncDone(w, req, discardRange(req));
+	else if (req->write)
+		syncDone(w, req, pwritev(req->fd, iov, n, req->pos));
+	else
+		syncDone(w, req, preadv(req->fd, iov, n, req->pos));
+}
+#endif
+
+#ifdef HAVE_SYS_MMAN_H
+/*
+ * The mmap engine maps the whole target once, shared by all workers,
+ * and moves data with memcpy(), so its cost is in page faults rather
+ * than system calls.
+ */
+static char **mapBase;		/* per target */
+
+static void
+mmapSetup(int target, int fd, int64_t size, int access)
+{
+	struct stat st;
+
+	/* touching a page past the end of a file raises SIGBUS */
+	MYASSERT(fstat(fd, &st) == 0, "fstat failed");
+	if (S_ISREG(st.st_mode) && st.st_size < size) {
+		fprintf(stderr, "Size %" PRId64 " is past the end of '%s' "
+		    "(%" PRId64 " bytes), which mmap can't reach\n", size,
+		    targets[target].name, (int64_t)st.st_size);
+		exit(1);
+	}
+	if ((size_t)size != size) {
+		fprintf(stderr, "Size %" PRId64 " too large to mmap\n", size);
+		exit(1);
+	}
+	if (mapBase == NULL &&
+	    (mapBase = calloc(ntargets, sizeof(*mapBase))) == NULL) {
+		fprintf(stderr, "malloc failed.\n");
+		exit(1);
+	}
+	mapBase[target] = mmap(NULL, size, access == O_RDONLY ? PROT_READ :
+	    PROT_READ | PROT_WRITE, MAP_SHARED, fd, 0);
+	if (mapBase[target] == MAP_FAILED) {
+		fprintf(stderr, "mmap of %" PRId64 " bytes failed: %s\n",
+		    size, strerror(errno));
+		exit(1);
+	}
+}
+
+static void
+mmapSubmit(struct worker *w, struct ioreq *req)
+{
+	if (req->discard) {
+		syncDone(w, req, discardRange(req));
+		return;
+	}
+	if (req->write)
+		memcpy(mapBase[req->target] + req->pos, req->buf, req->len);
+	else
+		memcpy(req->buf, mapBase[req->target] + req->pos, req->len);
+	syncDone(w, req, req->len);
+}
+#endif
+
+/*
+ * Each worker has its own PRNG, xoshiro256** (Blackman and Vigna), so
+ * there is no shared state to contend for, and a given -S seed gives
+ * each worker the same offsets and reads and writes on every run.
+ * Worker n is seeded with the n'th group of four outputs of splitmix64
+ * started from the seed.
+ */
+static uint64_t
+splitmix64(uint64_t *x)
+{
+	uint64_t z;
+
+	z = (*x += 0x9e3779b97f4a7c15ULL);
+	z = (z ^ (z >> 30)) * 0xbf58476d1ce4e5b9ULL;
+	z = (z ^ (z >> 27)) * 0x94d049bb133111ebULL;
+	return z ^ (z >> 31);
+}
+
+static void
+rngSeed(struct worker *w)
+{
+	uint64_t x;
+	int i;
+
+	x = seed + (uint64_t)w->tid * 4 * 0x9e3779b97f4a7c15ULL;
+	for (i = 0; i < 4; i++)
+		w->rng[i] = splitmix64(&x);
+}
+
+#define ROTL64(x, k)	(((x) << (k)) | ((x) >> (64 - (k))))
+
+static uint64_t
+rngNext(struct worker *w)
+{
+	uint64_t *s = w->rng;
+	uint64_t r, t;
+
+	r = ROTL64(s[1] * 5, 7) * 9;
+	t = s[1] << 17;
+	s[2] ^= s[0];
+	s[3] ^= s[1];
+	s[1] ^= s[2];
+	s[0] ^= s[3];
+	s[2] ^= t;
+	s[3] = ROTL64(s[3], 45);
+	return r;
+}
+
+/* uniform in (0, 1) */
+static double
+randUniform(struct worker *w)
+{
+	return ((rngNext(w) >> 11) + 0.5) / 9007199254740992.0;
+}
+
+/* uniform in [0, n) */
+static int64_t
+randBlock(struct worker *w, int64_t n)
+{
+	return rngNext(w) % n;
+}
+
+/*
+ * Access patterns.  nextBlock() picks the block for a worker's next
+ * I/O, according to -p.
+ */
+
+/*
+ * parsePattern:
+ * Parse a -p access pattern: rand, seq, stride:bytes, zipf:theta or
+ * hot:io%/space%.
+ */
+static void
+parsePattern(char *spec)
+{
+	char *p;
+
+	if (strcmp(spec, "rand") == 0)
+		pattern.type = PAT_RAND;
+	else if (strcmp(spec, "seq") == 0)
+		pattern.type = PAT_SEQ;
+	else if (strncmp(spec, "stride:", 7) == 0) {
+		pattern.type = PAT_STRIDE;
+		pattern.stride = getnum(spec + 7);
+		if (pattern.stride <= 0) {
+			fprintf(stderr, "Invalid stride: %s\n", spec + 7);
+			exit(1);
+		}
+	} else if (strncmp(spec, "zipf:", 5) == 0) {
+		pattern.type = PAT_ZIPF;
+		pattern.theta = strtod(spec + 5, &p);
+		if (*p != '\0' || pattern.theta <= 0) {
+			fprintf(stderr, "Invalid zipf theta: %s\n", spec + 5);
+			exit(1);
+		}
+	} else if (strncmp(spec, "hot:", 4) == 0) {
+		pattern.type = PAT_HOT;
+		pattern.hotIO = strtod(spec + 4, &p) / 100.0;
+		if (*p++ != '/') {
+			fprintf(stderr,
+			    "Hotspot pattern is hot:io%%/space%%\n");
+			exit(1);
+		}
+		pattern.hotSpace = strtod(p, &p) / 100.0;
+		if (*p != '\0' || pattern.hotIO < 0 || pattern.hotIO > 1 ||
+		    pattern.hotSpace <= 0 || pattern.hotSpace >= 1) {
+			fprintf(stderr, "Invalid hotspot pattern: %s\n", spec);
+			exit(1);
+		}
+	} else {
+		fprintf(stderr, "Unknown access pattern: %s\n", spec);
+		usage();
+		exit(1);
+	}
+}
+
+/*
+ * Zipf sampling by rejection-inversion (Hörmann and Derflinger, 1996),
+ * which needs no table or zeta(n), and works for any theta > 0.  Rank 1
+ * is block 0.
+ */
+static double
+zipfHelper1(double x)
+{
+	return fabs(x) > 1e-8 ? log1p(x) / x :
+	    1 - x * (0.5 - x * (1.0 / 3 - 0.25 * x));
+}
+
+static double
+zipfHelper2(double x)
+{
+	return fabs(x) > 1e-8 ? expm1(x) / x :
+	    1 + x * 0.5 * (1 + x / 3 * (1 + 0.25 * x));
+}
+
+static double
+zipfH(double x)
+{
+	return exp(-pattern.theta * log(x));
+}
+
+static double
+zipfHIntegral(double x)
+{
+	double lx = log(x);
+
+	return zipfHelper2((1 - pattern.theta) * lx) * lx;
+}
+
+static double
+zipfHIntegralInverse(double x)
+{
+	double t = x * (1 - pattern.theta);
+
+	if (t < -1)
+		t = -1;
+	return exp(zipfHelper1(t) * x);
+}
+
+static int64_t
+zipfBlock(struct worker *w)
+{
+	double u, x;
+	int64_t k;
+
+	for (;;) {
+		u = pattern.hn + randUniform(w) * (pattern.hx1 - pattern.hn);
+		x = zipfHIntegralInverse(u);
+		k = x + 0.5;
+		if (k < 1)
+			k = 1;
+		else if (k > patBlocks)
+			k = patBlocks;
+		if (k - x <= pattern.s ||
+		    u >= zipfHIntegral(k + 0.5) - zipfH(k))
+			return k - 1;
+	}
+}
+
+/*
+ * patternInit:
+ * Constants that depend on the target size.
+ */
+static void
+patternInit(void)
+{
+	if (pattern.type == PAT_STRIDE) {
+		pattern.step = pattern.stride / blockSize;
+		if (pattern.step < 1 || pattern.stride % blockSize != 0) {
+			fprintf(stderr, "Stride must be a multiple of the "
+			    "block size\n");
+			exit(1);
+		}
+	} else if (pattern.type == PAT_ZIPF) {
+		pattern.hx1 = zipfHIntegral(1.5) - 1;
+		pattern.hn = zipfHIntegral(patBlocks + 0.5);
+		pattern.s = 2 - zipfHIntegralInverse(zipfHIntegral(2.5) -
+		    zipfH(2));
+	} else if (pattern.type == PAT_HOT) {
+		pattern.hotBlocks = patBlocks * pattern.hotSpace;
+		if (pattern.hotBlocks < 1)
+			pattern.hotBlocks = 1;
+		if (pattern.hotBlocks >= patBlocks)
+			pattern.hotBlocks = patBlocks - 1;
+	}
+}
+
+/*
+ * nextBlock:
+ * Sequential and strided streams start each worker at its own share of
+ * the target and wrap at the end; each strided pass starts one block
+ * further on, so that every block is eventually visited.  A sequential
+ * I/O of 'units' blocks moves the stream on by that many.
+ */
+static int64_t
+nextBlock(struct worker *w, int64_t units)
+{
+	int64_t b;
+
+	switch (pattern.type) {
+	case PAT_SEQ:
+		if (w->next + units > patBlocks)
+			w->next = 0;
+		b = w->next;
+		w->next += units;
+		if (w->next >= patBlocks)
+			w->next = 0;
+		return b;
+	case PAT_STRIDE:
+		b = w->next;
+		w->next += pattern.step;
+		if (w->next >= patBlocks)
+			w->next = (w->next % patBlocks + 1) % pattern.step;
+		return b;
+	case PAT_ZIPF:
+		return zipfBlock(w);
+	case PAT_HOT:
+		if (randUniform(w) < pattern.hotIO)
+			return randBlock(w, pattern.hotBlocks);
+		return pattern.hotBlocks +
+		    randBlock(w, patBlocks - pattern.hotBlocks);
+	case PAT_RAND:
+	default:
+		return randBlock(w, patBlocks);
+	}
+}
+
+/*
+ * parseBlockSizes:
+ * Parse -b: a block size, or a mix of sizes with their weights, such
+ * as 4k:70,64k:20,1m:10.  Every size must be a multiple of the smallest,
+ * which becomes the unit that offsets are counted in.
+ */
+static void
+parseBlockSizes(char *spec)
+{
+	char *p;
+	int k;
+
+	free(bsizes);
+	bsizes = NULL;
+	nsizes = 0;
+	sizeWeight = 0;
+	for (p = spec; ; p++) {
+		bsizes = realloc(bsizes, (nsizes + 1) * sizeof(*bsizes));
+		if (bsizes == NULL) {
+			fprintf(stderr, "malloc failed.\n");
+			exit(1);
+		}
+		bsizes[nsizes].size = getnum(p);
+		bsizes[nsizes].weight = 1;
+		while (isdigit((int)*p))
+			p++;
+		if (isalpha((int)*p))
+			p++;
+		if (*p == ':')
+			bsizes[nsizes].weight = strtod(p + 1, &p);
+		if (bsizes[nsizes].size <= 0 || bsizes[nsizes].weight <= 0 ||
+		    (*p != ',' && *p != '\0')) {
+			fprintf(stderr, "Invalid block size: %s\n", spec);
+			exit(1);
+		}
+		sizeWeight += bsizes[nsizes++].weight;
+		if (*p == '\0')
+			break;
+	}
+	blockSize = maxBlockSize = bsizes[0].size;
+	for (k = 1; k < nsizes; k++) {
+		if (bsizes[k].size < blockSize)
+			blockSize = bsizes[k].size;
+		if (bsizes[k].size > maxBlockSize)
+			maxBlockSize = bsizes[k].size;
+	}
+	for (k = 0; k < nsizes; k++)
+		if (bsizes[k].size % blockSize != 0) {
+			fprintf(stderr, "Block size %ld is not a multiple of "
+			    "%ld\n", bsizes[k].size, blockSize);
+			exit(1);
+		}
+}
+
+/*
+ * pickSize:
+ * Choose the size of a worker's next I/O from the -b mix.
+ */
+static int
+pickSize(struct worker *w)
+{
+	double u;
+	int k;
+
+	if (nsizes == 1)
+		return 0;
+	u = randUniform(w) * sizeWeight;
+	for (k = 0; k < nsizes - 1 && u >= bsizes[k].weight; k++)
+		u -= bsizes[k].weight;
+	return k;
+}
+
+/*
+ * blockPos:
+ * Byte offset within target t of an I/O of len bytes at block b.  Only
+ * a mix of sizes or -A needs any work: random I/Os are aligned to their
+ * own size, or the -A alignment, a finer one starting them anywhere
+ * within the block at that alignment, and every I/O is kept within the
+ * target.  Sequential streams stay contiguous, so are not aligned.  All
+ * are then shifted by the -A offset.
+ */
+static off_t
+blockPos(struct worker *w, int64_t b, long len, int t)
+{
+	int64_t pos, end;
+	long a;
+
+	pos = b * blockSize;
+	a = ioAlign > 0 ? ioAlign : len;
+	if (len == blockSize && a == blockSize)
+		return pos + ioOffset;
+	if (pattern.type == PAT_SEQ || pattern.type == PAT_STRIDE)
+		a = len;
+	else {
+		if (a < blockSize)
+			pos += rngNext(w) % (blockSize / a) * a;
+		pos -= pos % a;
+	}
+	end = targets[t].blocks * blockSize;
+	if (pos + len > end)
+		pos = (end - len) / a * a;
+	return pos + ioOffset;
+}
+
+/*
+ * parseAlign:
+ * Parse -A: align[:offset], the alignment of random I/Os in bytes, and
+ * an offset added to every I/O; either may be left out, as in :512.
+ */
+static void
+parseAlign(char *spec)
+{
+	char *p;
+
+	p = strchr(spec, ':');
+	ioAlign = ioOffset = 0;
+	if (*spec != ':' && (!isdigit((int)*spec) ||
+	    (ioAlign = getnum(spec)) <= 0))
+		ioAlign = -1;
+	if (p != NULL && (!isdigit((int)p[1]) ||
+	    (ioOffset = getnum(p + 1)) < 0))
+		ioOffset = -1;
+	if (ioAlign < 0 || ioOffset < 0 || (ioAlign == 0 && ioOffset == 0 &&
+	    p == NULL)) {
+		fprintf(stderr, "Invalid alignment: %s\n", spec);
+		exit(1);
+	}
+}
+
+/*
+ * mapBlock:
+ * Turn a block of the combined address space into a target, returned,
+ * and a block within it.
+ */
+static int
+mapBlock(int64_t *b)
+{
+	int lo, hi, mid;
+
+	if (ntargets == 1)
+		return 0;
+	if (spread == SPREAD_RR) {
+		lo = *b % ntargets;
+		*b /= ntargets;
+		return lo;
+	}
+	for (lo = 0, hi = ntargets - 1; lo < hi; ) {
+		mid = (lo + hi + 1) / 2;
+		if (targets[mid].first <= *b)
+			lo = mid;
+		else
+			hi = mid - 1;
+	}
+	*b -= targets[lo].first;
+	return lo;
+}
+
+/*
+ * reqBusy:
+ * Whether the worker already has an I/O in flight to block b.  When
+ * verifying, a second I/O to the same block would make its contents
+ * uncertain, so we pick another.
+ */
+static int
+reqBusy(struct worker *w, int64_t b)
+{
+	int i;
+
+	for (i = 0; i < qdepth; i++)
+		if (w->reqs[i].block == b)
+			return 1;
+	return 0;
+}
+
+/*
+ * verifyStamp:
+ * Fill in the header of a block about to be written.
+ */
+static void
+verifyStamp(struct worker *w, struct ioreq *req)
+{
+	struct vheader *h = (struct vheader *)req->buf;
+
+	h->magic = VERIFY_MAGIC;
+	h->crc = 0;
+	h->pos = req->pos;
+	h->gen = genMap[req->block] + 1;
+	h->target = req->target;
+	h->tid = w->tid;
+	h->pad = 0;
+	h->crc = crc32c(0, req->buf, req->len);
+}
+
+/*
+ * verifyCheck:
+ * On completion of a write, note the generation now on disk.  On
+ * completion of a read of a block written this run, check that it
+ * holds what we last wrote there.  Returns -1 if it does not.
+ */
+static int
+verifyCheck(struct worker *w, struct ioreq *req, struct stats *st)
+{
+	struct vheader *h = (struct vheader *)req->buf;
+	uint32_t want, crc;
+	char why[PATH_MAX + 128];
+
+	if (req->discard) {
+		/* a discarded block may read back as anything */
+		genMap[req->block] = 0;
+		return 0;
+	}
+	if (req->write) {
+		/* a failed write leaves the block in an unknown state */
+		genMap[req->block] = req->ret == req->len ? h->gen : 0;
+		return 0;
+	}
+	if ((want = genMap[req->block]) == 0 || req->ret != req->len)
+		return 0;
+
+	st->verified++;
+	crc = h->crc;
+	h->crc = 0;
+	if (h->magic != VERIFY_MAGIC)
+		snprintf(why, sizeof(why), "no header, lost write?");
+	else if (crc32c(0, req->buf, req->len) != crc)
+		snprintf(why, sizeof(why), "checksum mismatch");
+	else if (h->pos != req->pos || h->target != req->target)
+		snprintf(why, sizeof(why), "misdirected write, header is for "
+		    "offset %" PRIu64 " of '%s'", h->pos,
+		    h->target < ntargets ? targets[h->target].name : "?");
+	else if (h->gen < want)
+		snprintf(why, sizeof(why), "stale data, generation %u of %u, "
+		    "lost write", h->gen, want);
+	else if (h->gen != want || h->tid != w->tid)
+		snprintf(why, sizeof(why), "generation %u from thread %u, "
+		    "expected %u from thread %d", h->gen, h->tid, want,
+		    w->tid);
+	else
+		return 0;
+	st->badVerify++;
+	fprintf(stderr, "verify failed on '%s', offset %" PRId64 ": %s\n",
+	    targets[req->target].name, (int64_t)req->pos, why);
+	return -1;
+}
+
+/*
+ * parseRate:
+ * Parse a -R open-loop rate, total IOs/sec over all workers: a number,
+ * fixed:rate or poisson:rate.
+ */
+static void
+parseRate(char *spec)
+{
+	char *p;
+
+	if (strncmp(spec, "fixed:", 6) == 0) {
+		ratePoisson = 0;
+		p = spec + 6;
+	} else if (strncmp(spec, "poisson:", 8) == 0) {
+		ratePoisson = 1;
+		p = spec + 8;
+	} else {
+		ratePoisson = 0;
+		p = spec;
+	}
+	rate = strtod(p, &p);
+	if (*p != '\0' || rate <= 0) {
+		fprintf(stderr, "Invalid rate: %s\n", spec);
+		exit(1);
+	}
+}
+
+/*
+ * parseFlush:
+ * Parse -F: fsync, fdatasync or range (sync_file_range(2) of the
+ * write just done), and how often: :n after every nth write, or :n%
+ * after that share of them, chosen at random.  The default is after
+ * every write; none turns flushes off, for a phase of a job.
+ */
+static void
+parseFlush(char *spec)
+{
+	const char *name;
+	double pct;
+	size_t len;
+	char *p;
+	int i;
+
+	p = strchr(spec, ':');
+	len = p != NULL ? p - spec : strlen(spec);
+	for (i = FLUSH_NONE; i <= FLUSH_RANGE; i++) {
+		name = i == FLUSH_RANGE ? "range" : flushNames[i];
+		if (strlen(name) == len && strncmp(spec, name, len) == 0)
+			break;
+	}
+	if (i > FLUSH_RANGE || (i == FLUSH_NONE && p != NULL)) {
+		fprintf(stderr, "Invalid flush: %s\n", spec);
+		exit(1);
+	}
+#if !HAVE_FDATASYNC
+	if (i == FLUSH_FDATASYNC) {
+		fprintf(stderr, "fdatasync not supported on this platform\n");
+		exit(1);
+	}
+#endif
+#if !HAVE_SYNC_FILE_RANGE
+	if (i == FLUSH_RANGE) {
+		fprintf(stderr, "sync_file_range not supported on this "
+		    "platform\n");
+		exit(1);
+	}
+#endif
+	flushKind = i;
+	flushEvery = 1;
+	flushLim = 0;
+	if (p == NULL)
+		return;
+	pct = strtod(p + 1, &p);
+	if (*p == '%' && p[1] == '\0' && pct > 0 && pct <= 100) {
+		flushEvery = 0;
+		flushLim = pct * 1024 / 100;
+		if (flushLim == 0)
+			flushLim = 1;
+	} else if (*p == '\0' && pct >= 1 && pct == (int)pct)
+		flushEvery = pct;
+	else {
+		fprintf(stderr, "Invalid flush: %s\n", spec);
+		exit(1);
+	}
+}
+
+/*
+ * flushIO:
+ * Flush the target of the write w->flush, recording the latency.
+ * Returns -1 if it failed.
+ */
+static int
+flushIO(struct worker *w, struct stats *st)
+{
+	struct ioreq *req = &w->flush;
+	int64_t start;
+	int ret;
+
+	w->flushDue = 0;
+	start = nanotime();
+	switch (flushKind) {
+#if HAVE_FDATASYNC
+	case FLUSH_FDATASYNC:
+		ret = fdatasync(req->fd);
+		break;
+#endif
+#if HAVE_SYNC_FILE_RANGE
+	case FLUSH_RANGE:
+		ret = sync_file_range(req->fd, req->pos, req->len,
+		    SYNC_FILE_RANGE_WAIT_BEFORE | SYNC_FILE_RANGE_WRITE |
+		    SYNC_FILE_RANGE_WAIT_AFTER);
+		break;
+#endif
+	default:
+		ret = fsync(req->fd);
+		break;
+	}
+	if (ret != 0) {
+		fprintf(stderr, "%s failed on '%s': %d (%s)\n",
+		    flushNames[flushKind], targets[req->target].name, errno,
+		    strerror(errno));
+		return -1;
+	}
+	histRecord(&st[req->target].fl, nanotime() - start);
+	return 0;
+}
+
+/*
+ * interArrival:
+ * Time from one of a worker's I/Os to its next, in ns.  Each worker
+ * runs at its share of the -R rate.
+ */
+static int64_t
+interArrival(struct worker *w)
+{
+	double mean = threads * 1e9 / rate;
+
+	if (ratePoisson)
+		return -mean * log(randUniform(w)) + 0.5;
+	return mean + 0.5;
+}
+
+/*
+ * sleepUntil:
+ * Wait for nanotime() to reach t, sleeping for most of the time and
+ * spinning for the last SPIN_NS so that we wake up on time.  Returns
+ * nanotime().
+ */
+#define SPIN_NS		50000
+
+static int64_t
+sleepUntil(int64_t t)
+{
+	int64_t now;
+#if HAVE_NANOSLEEP
+	struct timespec ts;
+#endif
+
+	now = nanotime();
+#if HAVE_NANOSLEEP
+	if (t - now > SPIN_NS) {
+		ts.tv_sec = (t - now - SPIN_NS) / 1000000000;
+		ts.tv_nsec = (t - now - SPIN_NS) % 1000000000;
+		nanosleep(&ts, NULL);
+	}
+#endif
+	while (now < t)
+		now = nanotime();
+	return now;
+}
+
+/*
+ * The null engine completes every I/O as soon as it is submitted,
+ * without touching the target, so the rate it reaches is the ceiling
+ * of iohammer itself.
+ */
+static void
+nullSubmit(struct worker *w, struct ioreq *req)
+{
+	req->ret = req->len;
+	w->done[w->ndone++] = req;
+}
+
+/*
+ * The sim engine is a fake device: each I/O completes after a latency
+ * drawn from the -L distribution, without touching the target.  Pending
+ * I/Os are kept in a min-heap on their due time.
+ */
+struct simio {
+	int64_t		due;
+	struct ioreq	*req;
+};
+
+struct sim {
+	int		n;
+	struct simio	heap[1];	/* qdepth entries */
+};
+
+/*
+ * parseLatency:
+ * Parse a -L latency distribution: a time, or one of fixed:t, exp:mean,
+ * uniform:min:max or normal:mean:stddev.
+ */
+static void
+parseLatency(char *spec)
+{
+	char *p;
+
+	if (strncmp(spec, "fixed:", 6) == 0) {
+		simLat.dist = LAT_FIXED;
+		p = spec + 6;
+	} else if (strncmp(spec, "exp:", 4) == 0) {
+		simLat.dist = LAT_EXP;
+		p = spec + 4;
+	} else if (strncmp(spec, "uniform:", 8) == 0) {
+		simLat.dist = LAT_UNIFORM;
+		p = spec + 8;
+	} else if (strncmp(spec, "normal:", 7) == 0) {
+		simLat.dist = LAT_NORMAL;
+		p = spec + 7;
+	} else {
+		simLat.dist = LAT_FIXED;
+		p = spec;
+	}
+	simLat.a = getduration(p, &p) * 1e9;
+	simLat.b = 0;
+	if (simLat.dist == LAT_UNIFORM || simLat.dist == LAT_NORMAL) {
+		if (*p++ != ':') {
+			fprintf(stderr, "Latency distribution '%s' needs two "
+			    "parameters\n", spec);
+			exit(1);
+		}
+		simLat.b = getduration(p, &p) * 1e9;
+	}
+	if (*p != '\0' || simLat.a < 0 || simLat.b < 0 ||
+	    (simLat.dist == LAT_UNIFORM && simLat.b < simLat.a)) {
+		fprintf(stderr, "Invalid latency distribution: %s\n", spec);
+		exit(1);
+	}
+}
+
+static int64_t
+simLatency(struct worker *w)
+{
+	double lat;
+
+	switch (simLat.dist) {
+	case LAT_UNIFORM:
+		lat = simLat.a + (simLat.b - simLat.a) * randUniform(w);
+		break;
+	case LAT_EXP:
+		lat = -simLat.a * log(randUniform(w));
+		break;
+	case LAT_NORMAL:
+		/* Box-Muller, clamped at zero */
+		lat = simLat.a + simLat.b * sqrt(-2.0 * log(randUniform(w))) *
+		    cos(2.0 * M_PI * randUniform(w));
+		if (lat < 0)
+			lat = 0;
+		break;
+	case LAT_FIXED:
+	default:
+		lat = simLat.a;
+		break;
+	}
+	return lat;
+}
+
+static void
+simInit(struct worker *w)
+{
+	struct sim *s;
+
+	s = malloc(sizeof(*s) + (qdepth - 1) * sizeof(struct simio));
+	if (s == NULL) {
+		fprintf(stderr, "malloc failed.\n");
+		exit(1);
+	}
+	s->n = 0;
+	w->priv = s;
+}
+
+static void
+simSubmit(struct worker *w, struct ioreq *req)
+{
+	struct sim *s = w->priv;
+	int64_t due;
+	int i;
+
+	due = nanotime() + simLatency(w);
+	for (i = s->n++; i > 0 && s->heap[(i - 1) / 2].due > due;
+	    i = (i - 1) / 2)
+		s->heap[i] = s->heap[(i - 1) / 2];
+	s->heap[i].due = due;
+	s->heap[i].req = req;
+}
+
+static int
+simReap(struct worker *w)
+{
+	struct sim *s = w->priv;
+	struct simio last;
+	int64_t now;
+	int i, c, n;
+
+	if (w->wake != 0 && w->wake < s->heap[0].due)
+		now = sleepUntil(w->wake);
+	else
+		now = sleepUntil(s->heap[0].due);
+
+	for (n = 0; s->n > 0 && s->heap[0].due <= now; n++) {
+		s->heap[0].req->ret = s->heap[0].req->len;
+		w->done[n] = s->heap[0].req;
+		last = s->heap[--s->n];
+		for (i = 0; (c = 2 * i + 1) < s->n; i = c) {
+			if (c + 1 < s->n && s->heap[c + 1].due < s->heap[c].due)
+				c++;
+			if (last.due <= s->heap[c].due)
+				break;
+			s->heap[i] = s->heap[c];
+		}
+		s->heap[i] = last;
+	}
+	return n;
+}
+
+static void
+simFini(struct worker *w)
+{
+	free(w->priv);
+}
+
+#ifdef HAVE_IO_URING
+/*
+ * Minimal io_uring plumbing.  We drive the rings directly through the
+ * system calls rather than pull in liburing for the handful of
+ * operations we need.
+ */
+struct uring {
+	int		fd;
+	unsigned	tail;		/* our copy of the SQ tail */
+	int		extArg;		/* kernel takes a timeout on enter */
+	int		punch;		/* IORING_OP_FALLOCATE punches holes */
+	int		blkDiscard;	/* IORING_OP_URING_CMD discards */
+	unsigned	*sqhead, *sqtail, *sqmask, *sqarray;
+	unsigned	*cqhead, *cqtail, *cqmask;
+	struct io_uring_sqe *sqes;
+	struct io_uring_cqe *cqes;
+};
+
+/* user_data flag: completed at submission, the CQE is of a no-op */
+#define URING_DONE	1
+
+#if HAVE_DECL_IORING_OP_FALLOCATE || HAVE_DECL_IORING_OP_URING_CMD
+/*
+ * uringProbe:
+ * Whether the ring's kernel has an operation.  Discards not passed to
+ * the kernel this way are done at submission instead.
+ */
+static int
+uringProbe(int fd, int op)
+{
+#ifdef __NR_io_uring_register
+	struct io_uring_probe *pr;
+	int ok;
+
+	pr = calloc(1, sizeof(*pr) + 256 * sizeof(struct io_uring_probe_op));
+	MYASSERT(pr != NULL, "malloc failed");
+	ok = syscall(__NR_io_uring_register, fd, IORING_REGISTER_PROBE,
+	    pr, 256) == 0 && op <= pr->last_op &&
+	    (pr->ops[op].flags & IO_URING_OP_SUPPORTED);
+	free(pr);
+	return ok;
+#else
+	return 0;
+#endif
+}
+#endif
+
+static void
+uringInit(struct worker *w)
+{
+	struct io_uring_params p;
+	struct uring *r;
+	size_t sqlen, cqlen;
+	char *sq, *cq;
+
+	if ((r = malloc(sizeof(*r))) == NULL) {
+		fprintf(stderr, "malloc failed.\n");
+		exit(1);
+	}
+	memset(&p, 0, sizeof(p));
+	r->fd = syscall(__NR_io_uring_setup, qdepth, &p);
+	if (r->fd < 0) {
+		fprintf(stderr, "io_uring_setup failed: %s\n",
+		    strerror(errno));
+		exit(1);
+	}
+	sqlen = p.sq_off.array + p.sq_entries * sizeof(unsigned);
+	cqlen = p.cq_off.cqes + p.cq_entries * sizeof(struct io_uring_cqe);
+	if ((p.features & IORING_FEAT_SINGLE_MMAP) && cqlen > sqlen)
+		sqlen = cqlen;
+	sq = mmap(NULL, sqlen, PROT_READ | PROT_WRITE, MAP_SHARED,
+	    r->fd, IORING_OFF_SQ_RING);
+	MYASSERT(sq != MAP_FAILED, "mmap of io_uring SQ ring failed");
+	if (p.features & IORING_FEAT_SINGLE_MMAP)
+		cq = sq;
+	else {
+		cq = mmap(NULL, cqlen, PROT_READ | PROT_WRITE, MAP_SHARED,
+		    r->fd, IORING_OFF_CQ_RING);
+		MYASSERT(cq != MAP_FAILED, "mmap of io_uring CQ ring failed");
+	}
+	r->sqes = mmap(NULL, p.sq_entries * sizeof(struct io_uring_sqe),
+	    PROT_READ | PROT_WRITE, MAP_SHARED, r->fd, IORING_OFF_SQES);
+	MYASSERT(r->sqes != MAP_FAILED, "mmap of io_uring SQEs failed");
+
+	r->sqhead = (unsigned *)(sq + p.sq_off.head);
+	r->sqtail = (unsigned *)(sq + p.sq_off.tail);
+	r->sqmask = (unsigned *)(sq + p.sq_off.ring_mask);
+	r->sqarray = (unsigned *)(sq + p.sq_off.array);
+	r->cqhead = (unsigned *)(cq + p.cq_off.head);
+	r->cqtail = (unsigned *)(cq + p.cq_off.tail);
+	r->cqmask = (unsigned *)(cq + p.cq_off.ring_mask);
+	r->cqes = (struct io_uring_cqe *)(cq + p.cq_off.cqes);
+	r->tail = *r->sqtail;
+#ifdef IORING_FEAT_EXT_ARG
+	r->extArg = (p.features & IORING_FEAT_EXT_ARG) != 0;
+#else
+	r->extArg = 0;
+#endif
+	r->punch = r->blkDiscard = 0;
+#if HAVE_DECL_IORING_OP_FALLOCATE && defined(FALLOC_FL_PUNCH_HOLE)
+	r->punch = uringProbe(r->fd, IORING_OP_FALLOCATE);
+#endif
+#if HAVE_DECL_IORING_OP_URING_CMD
+	r->blkDiscard = uringProbe(r->fd, IORING_OP_URING_CMD);
+#endif
+	w->priv = r;
+}
+
+/*
+ * Queue a request; it is not passed to the kernel until the next reap.
+ */
+static void
+uringSubmit(struct worker *w, struct ioreq *req)
+{
+	struct uring *r = w->priv;
+	struct io_uring_sqe *sqe;
+	unsigned idx;
+
+	idx = r->tail & *r->sqmask;
+	sqe = &r->sqes[idx];
+	memset(sqe, 0, sizeof(*sqe));
+	sqe->fd = req->fd;
+	sqe->user_data = (uintptr_t)req;
+	if (!req->discard) {
+		sqe->opcode = req->write ? IORING_OP_WRITE : IORING_OP_READ;
+		sqe->addr = (uintptr_t)req->buf;
+		sqe->len = req->len;
+		sqe->off = req->pos;
+#if HAVE_DECL_IORING_OP_URING_CMD
+	} else if (targets[req->target].blkdev && r->blkDiscard) {
+		sqe->opcode = IORING_OP_URING_CMD;
+		sqe->cmd_op = BLOCK_URING_CMD_DISCARD;
+		sqe->addr = req->pos;
+		sqe->addr3 = req->len;
+#endif
+#if HAVE_DECL_IORING_OP_FALLOCATE && defined(FALLOC_FL_PUNCH_HOLE)
+	} else if (!targets[req->target].blkdev && r->punch) {
+		/* the length goes in addr, and the mode in len */
+		sqe->opcode = IORING_OP_FALLOCATE;
+		sqe->addr = req->len;
+		sqe->len = FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE;
+		sqe->off = req->pos;
+#endif
+	} else {
+		/* the kernel can't, so done here and completed by a no-op */
+		req->ret = discardRange(req);
+		if (req->ret < 0)
+			req->ret = -errno;
+		sqe->opcode = IORING_OP_NOP;
+		sqe->user_data |= URING_DONE;
+	}
+	r->sqarray[idx] = idx;
+	r->tail++;
+}
+
+/*
+ * Submit everything queued, wait for at least one completion, then
+ * collect all that are ready.  With w->wake set, the wait is bounded;
+ * kernels without IORING_FEAT_EXT_ARG (before 5.11) do not wait at all,
+ * and the worker polls.
+ */
+static int
+uringReap(struct worker *w)
+{
+	struct uring *r = w->priv;
+	struct io_uring_cqe *cqe;
+	struct ioreq *req;
+	unsigned head, tail, submit, flags, wait;
+	int ret, n;
+	void *arg;
+	size_t argsz;
+#ifdef IORING_FEAT_EXT_ARG
+	struct io_uring_getevents_arg ea;
+	struct __kernel_timespec ts;
+	int64_t left;
+#endif
+
+	__atomic_store_n(r->sqtail, r->tail, __ATOMIC_RELEASE);
+	do {
+		submit = r->tail - __atomic_load_n(r->sqhead,
+		    __ATOMIC_ACQUIRE);
+		flags = IORING_ENTER_GETEVENTS;
+		wait = 1;
+		arg = NULL;
+		argsz = 0;
+		if (w->wake != 0 && !r->extArg)
+			wait = 0;
+#ifdef IORING_FEAT_EXT_ARG
+		else if (w->wake != 0) {
+			left = w->wake - nanotime();
+			if (left < 0)
+				left = 0;
+			ts.tv_sec = left / 1000000000;
+			ts.tv_nsec = left % 1000000000;
+			memset(&ea, 0, sizeof(ea));
+			ea.ts = (uintptr_t)&ts;
+			flags |= IORING_ENTER_EXT_ARG;
+			arg = &ea;
+			argsz = sizeof(ea);
+		}
+#endif
+		ret = syscall(__NR_io_uring_enter, r->fd, submit, wait,
+		    flags, arg, argsz);
+	} while (ret < 0 && errno == EINTR);
+	MYASSERT(ret >= 0 || errno == ETIME, "io_uring_enter failed");
+
+	n = 0;
+	head = *r->cqhead;
+	tail = __atomic_load_n(r->cqtail, __ATOMIC_ACQUIRE);
+	for (; head != tail; head++) {
+		cqe = &r->cqes[head & *r->cqmask];
+		req = (struct ioreq *)(uintptr_t)(cqe->user_data &
+		    ~(uint64_t)URING_DONE);
+		if (cqe->user_data & URING_DONE)
+			;
+		else if (!req->discard)
+			req->ret = cqe->res;
+		else if (cqe->res == -EOPNOTSUPP &&
+		    targets[req->target].blkdev) {
+			/* no block uring_cmd before 6.12: do it here */
+			r->blkDiscard = 0;
+			if ((req->ret = discardRange(req)) < 0)
+				req->ret = -errno;
+		} else
+			req->ret = cqe->res == 0 ? req->len : cqe->res;
+		w->done[n++] = req;
+	}
+	__atomic_store_n(r->cqhead, head, __ATOMIC_RELEASE);
+	return n;
+}
+
+static void
+uringFini(struct worker *w)
+{
+	struct uring *r = w->priv;
+
+	close(r->fd);
+	free(r);
+}
+#endif /* HAVE_IO_URING */
+
+#ifdef USE_PTHREADS
+static void *
+status(void *dummy)
+{
+	while (!ATOMIC_LOAD(&flAborted) && !flFinished) {
+		statusLine(totalIO(NULL), iolimit, "IOs", "IO/s");
+		usleep(STATUS_UPDATE_TIME);
 	}
+	fputc('\n', stderr);
+	return 0;
+}
 
-	if (flAborted)
-		for (i = 0; i < threads; i++)
-#ifdef USE_PTHREADS
-			pthread_cancel(tid[i]);
-#else
-			kill(pid[i], SIGTERM);
-#endif
-	exit(0);
+/*
+ * sampler:
+ * Write the -o log every -I interval, waking at least every
+ * SAMPLE_POLL_NS to see whether the run has finished; main writes the
+ * last, partial, interval.
+ */
+#define SAMPLE_POLL_NS	50000000
+
+static void *
+sampler(void *dummy)
+{
+	int64_t next, now;
+
+	next = nanotime() + logEvery;
+	while (!ATOMIC_LOAD(&flAborted) && !flFinished) {
+		now = nanotime();
+		if (now < next) {
+			sleepUntil(next - now > SAMPLE_POLL_NS ?
+			    now + SAMPLE_POLL_NS : next);
+			continue;
+		}
+		logSample(now, 0);
+		while (next <= now)
+			next += logEvery;
+	}
+	return 0;
 }
 
+/*
+ * steadyWatch:
+ * End a phase of a job once it reaches its steady state.
+ */
 static void *
-doIO(void *arg)
+steadyWatch(void *arg)
 {
-	char tok;
-	int writeFlag, tid;
-	long seed;
-	off_t pos, seekRet;
-	ssize_t ioRet;
-	struct timeval tmout;
-	char *buf;
+	struct steady *st = arg;
+	int64_t now;
 
-	tid = (intptr_t)arg;
-	if ((buf = malloc(blockSize)) == NULL) {
-		fprintf(stderr, "malloc for %ld bytes failed.", blockSize);
-		exit(1);
+	while (!ATOMIC_LOAD(&flAborted) && !flFinished) {
+		now = nanotime();
+		if (now < st->next) {
+			sleepUntil(st->next - now > SAMPLE_POLL_NS ?
+			    now + SAMPLE_POLL_NS : st->next);
+			continue;
+		}
+		if (steadyRound(st, now)) {
+			ATOMIC_STORE(&ctl->deadline, now);
+			break;
+		}
+		st->next += st->round;
 	}
-	MYASSERT(gettimeofday(&tmout, NULL) == 0, "gettimeofday failed");
-	writeFlag = 0;
-#ifdef USE_PTHREADS
-	seed = tmout.tv_usec ^ tmout.tv_sec ^ (long)&seed;
-#else
-	seed = tmout.tv_usec ^ tmout.tv_sec ^ getpid();
+	return 0;
+}
 #endif
-	SRAND(seed);
-	srandom(seed);
-	for (;;) {
-		pos = random() % fileBlocks * blockSize;
-		if ((RAND() & 0x03ff) < writeLim) {	/* write */
-			writeFlag = 1;
-			initblock(buf, blockSize, type, 1);
-		} else
-			writeFlag = 0;
-#ifndef USE_PTHREADS
-		MYASSERT(read(pipe_ctl_r[tid], &tok, 1) == 1,
-		    "pipe read failed");
-		if (tok == 0) {
-			_exit(0);	/* finished */
+
+/*
+ * placeWorkers:
+ * Parse -C: a list of CPUs such as 0-3,8-11, which the workers are
+ * pinned to one each in turn, or node, or node:list, which spreads them
+ * in turn over all or the listed NUMA nodes, each free to run on any
+ * CPU of its node.  A worker's buffers are faulted in after it is
+ * pinned, so they come from its own node.
+ */
+#define NODE_DIR	"/sys/devices/system/node"
+
+static void
+placeWorkers(char *spec)
+{
+#if HAVE_AFFINITY
+	cpu_set_t set, allowed;
+	int i, n, node, *list;
+	char path[64];
+	FILE *fp;
+
+	placement = calloc(threads, sizeof(*placement));
+	placeNode = malloc(threads * sizeof(*placeNode));
+	list = malloc(CPU_SETSIZE * sizeof(*list));
+	MYASSERT(placement != NULL && placeNode != NULL && list != NULL,
+	    "malloc failed");
+	CPU_ZERO(&set);
+	node = strncmp(spec, "node", 4) == 0;
+	if (node && spec[4] == '\0') {
+		if ((fp = fopen(NODE_DIR "/online", "r")) == NULL ||
+		    fgets(path, sizeof(path), fp) == NULL) {
+			fprintf(stderr, "Can't read " NODE_DIR "/online\n");
+			exit(1);
 		}
-#endif
-		if ((seekRet = lseek(fds[tid], pos, SEEK_SET)) == -1) {
-			perror("lseek failed");
+		fclose(fp);
+		path[strcspn(path, "\n")] = '\0';
+		spec = path;
+	} else if (node && spec[4] == ':')
+		spec += 5;
+	else
+		node = 0;
+	if (parseCpuList(spec, &set) != 0) {
+		fprintf(stderr, "Invalid %s list: %s\n",
+		    node ? "node" : "CPU", spec);
+		exit(1);
+	}
+	for (i = 0, n = 0; i < CPU_SETSIZE; i++)
+		if (CPU_ISSET(i, &set))
+			list[n++] = i;
+	MYASSERT(sched_getaffinity(0, sizeof(allowed), &allowed) == 0,
+	    "sched_getaffinity failed");
+	for (i = 0; i < threads; i++) {
+		CPU_ZERO(&placement[i]);
+		placeNode[i] = node ? list[i % n] : -1;
+		if (node)
+			nodeCpus(placeNode[i], &placement[i]);
+		else
+			CPU_SET(list[i % n], &placement[i]);
+		/* we may be confined to some CPUs already */
+		CPU_AND(&placement[i], &placement[i], &allowed);
+		if (CPU_COUNT(&placement[i]) == 0 && node) {
+			fprintf(stderr, "No CPUs of node %d are available\n",
+			    placeNode[i]);
+			exit(1);
+		} else if (CPU_COUNT(&placement[i]) == 0) {
+			fprintf(stderr, "CPU %d is not available\n",
+			    list[i % n]);
 			exit(1);
 		}
-		if (writeFlag) {
-			ioRet = write(fds[tid], buf, blockSize);
-			tok = 1;
-		} else {
-			ioRet = read(fds[tid], buf, blockSize);
-			tok = 0;
-		}
-		if (ioRet == -1) {
-			fprintf(stderr, "%s I/O failed, offset %" PRId64
-			    ": %d (%s)\n",
-			    writeFlag ? "write" : "read",
-			    (int64_t)pos, errno, strerror(errno));
-			if (!ignore) {
-				flAborted = 1;
-#ifdef USE_PTHREADS
-				pthread_exit(0);
+	}
+	free(list);
 #else
-				_exit(1);
+	fprintf(stderr, "CPU placement not supported on this platform\n");
+	exit(1);
 #endif
-			}
+}
+
+/*
+ * printPlacement:
+ * The CPUs, and node, each worker was pinned to.  Unformatted, a line
+ * of "placement" and then a CPU list for each worker, with "@node"
+ * appended when placed by node.
+ */
+static void
+printPlacement(int unformatted)
+{
+#if HAVE_AFFINITY
+	char buf[256];
+	int i;
+
+	if (unformatted)
+		printf("placement");
+	for (i = 0; i < threads; i++) {
+		cpuListString(&placement[i], buf, sizeof(buf));
+		if (unformatted && placeNode[i] >= 0)
+			printf("\t%s@%d", buf, placeNode[i]);
+		else if (unformatted)
+			printf("\t%s", buf);
+		else if (placeNode[i] >= 0)
+			printf("thread %d on node %d, CPUs %s\n", i,
+			    placeNode[i], buf);
+		else
+			printf("thread %d on CPU %s\n", i, buf);
+	}
+	if (unformatted)
+		putchar('\n');
+#endif
+}
+
+#if HAVE_AFFINITY
+/*
+ * parseCpuList:
+ * Parse a list in the kernel's cpulist format, such as 0-3,8,10-11.
+ */
+static int
+parseCpuList(char *s, cpu_set_t *set)
+{
+	long lo, hi;
+	char *p;
+
+	CPU_ZERO(set);
+	for (;;) {
+		lo = hi = strtol(s, &p, 10);
+		if (p == s)
+			return -1;
+		if (*p == '-') {
+			s = p + 1;
+			hi = strtol(s, &p, 10);
+			if (p == s)
+				return -1;
 		}
-		if (ioRet < blockSize) {
-			fprintf(stderr, "short %s I/O, offset %" PRId64 ", %"
-			    PRId64 " bytes\n",
-			    writeFlag ? "write" : "read",
-			    (int64_t)pos, (int64_t)ioRet);
+		if (lo < 0 || hi < lo || hi >= CPU_SETSIZE)
+			return -1;
+		for (; lo <= hi; lo++)
+			CPU_SET(lo, set);
+		if (*p == '\0')
+			return 0;
+		if (*p != ',')
+			return -1;
+		s = p + 1;
+	}
+}
+
+/*
+ * nodeCpus:
+ * The CPUs of a NUMA node.
+ */
+static void
+nodeCpus(int node, cpu_set_t *set)
+{
+	char path[64], *buf;
+	FILE *fp;
+
+	MYASSERT((buf = malloc(4096)) != NULL, "malloc failed");
+	snprintf(path, sizeof(path), NODE_DIR "/node%d/cpulist", node);
+	if ((fp = fopen(path, "r")) == NULL || fgets(buf, 4096, fp) == NULL) {
+		fprintf(stderr, "No NUMA node %d\n", node);
+		exit(1);
+	}
+	fclose(fp);
+	buf[strcspn(buf, "\n")] = '\0';
+	if (parseCpuList(buf, set) != 0 || CPU_COUNT(set) == 0) {
+		fprintf(stderr, "NUMA node %d has no CPUs\n", node);
+		exit(1);
+	}
+	free(buf);
+}
+
+/*
+ * cpuListString:
+ * Format a CPU set as a list such as 0-3,8.
+ */
+static void
+cpuListString(const cpu_set_t *set, char *buf, size_t len)
+{
+	size_t n;
+	int i, j;
+
+	buf[0] = '\0';
+	for (i = 0, n = 0; i < CPU_SETSIZE && n < len; i = j) {
+		if (!CPU_ISSET(i, set)) {
+			j = i + 1;
+			continue;
 		}
-#ifdef USE_PTHREADS
-		MYASSERT(pthread_mutex_lock(&lock) == 0,
-		    "pthread_mutex_lock failed");
-		numio++;
-		if (writeFlag)
-			numWrites++;
-		if (flAborted || (iolimit > 0 && numio + threads >= iolimit + 1))
-			break;		/* finished */
-		MYASSERT(pthread_mutex_unlock(&lock) == 0,
-		    "pthread_mutex_unlock failed");
-#else
-		MYASSERT(write(pipe_cnt_w[tid], &tok, 1) == 1,
-		    "write to pipe failed");
-#endif
+		for (j = i + 1; j < CPU_SETSIZE && CPU_ISSET(j, set); j++)
+			;
+		if (j - 1 == i)
+			n += snprintf(buf + n, len - n, "%s%d",
+			    n ? "," : "", i);
+		else
+			n += snprintf(buf + n, len - n, "%s%d-%d",
+			    n ? "," : "", i, j - 1);
 	}
-#ifdef USE_PTHREADS
-	MYASSERT(pthread_cond_signal(&cond) == 0,
-	    "pthread_cond_signal failed");
-	MYASSERT(pthread_mutex_unlock(&lock) == 0,
-	    "pthread_mutex_unlock failed");
-#endif
-	return NULL;
 }
+#endif
 
-static void *
-status(void *dummy)
+/*
+ * addTarget:
+ * Add a -f file, directory or device to the run.
+ */
+static void
+addTarget(const char *name)
 {
-	while (!flAborted && ((numio < iolimit) || (iolimit == 0))) { //stix
-		statusLine(numio, iolimit, "IOs", "IO/s");
-		usleep(STATUS_UPDATE_TIME);
+	targets = realloc(targets, (ntargets + 1) * sizeof(*targets));
+	if (targets == NULL) {
+		fprintf(stderr, "malloc failed.\n");
+		exit(1);
 	}
-	fputc('\n', stderr);
-	return 0;
+	memset(&targets[ntargets], 0, sizeof(*targets));
+	strncpy(targets[ntargets].name, name,
+	    sizeof(targets[ntargets].name) - 1);
+	ntargets++;
 }
 
 static void
@@ -425,7 +4617,9 @@ openfile(int **fds, char *name, int64_t *fileSize, int threads, int access)
 	struct stat sb;
 	int fd, i, isTemp;
 	int64_t size;
-	char *blck;
+#ifdef BLKGETSIZE64
+	uint64_t bytes;
+#endif
 	isTemp = fd = 0;
 
 	if (stat(name, &sb) != 0) {
@@ -458,48 +4652,43 @@ openfile(int **fds, char *name, int64_t *fileSize, int threads, int access)
 		fprintf(stderr, "malloc failed.\n");
 		exit(1);
 	}
+#ifdef O_DIRECT
+	if (direct)
+		access |= O_DIRECT;
+#endif
 	for (i = 0; i < threads; i++) {
 		if (((*fds)[i] = open(name, access)) < 0) {
-			fprintf(stderr, "Failed to open fd %d to file/device "
-			    "'%s': %s\n", i, name, strerror(errno));
+			if (direct && errno == EINVAL)
+				fprintf(stderr, "Direct I/O (O_DIRECT) refused "
+				    "for '%s': not supported by the "
+				    "filesystem\n", name);
+			else
+				fprintf(stderr, "Failed to open fd %d to "
+				    "file/device '%s': %s\n", i, name,
+				    strerror(errno));
+			exit(1);
+		}
+#if !defined(O_DIRECT) && defined(F_NOCACHE)
+		if (direct && fcntl((*fds)[i], F_NOCACHE, 1) == -1) {
+			fprintf(stderr, "Direct I/O (F_NOCACHE) refused for "
+			    "'%s': %s\n", name, strerror(errno));
 			exit(1);
 		}
+#endif
 	}
 	if (isTemp) {
 		unlink(name);
-		/*
-		 * write blocks of zeros to allocate blocks on disk upto
-		 * the size requested
-		 */
-		blck = malloc(65536);
-		if (blck == NULL) {
-			fprintf(stderr, "malloc failed: %s\n", strerror(errno));
-			exit(1);
-		}
-		bzero(blck, 65536);
-		/* start with 64k blocks, for speed */
-		for (i = 0; i < (*fileSize >> 16); i++) {
-			if (write(fd, blck, 65536) != 65536) {
-				fprintf(stderr, "Write failed: %s\n",
-				    strerror(errno));
-				exit(1);
-			}
-		}
-		/* then individual bytes until we're there */
-		for (i = 0; i < (*fileSize - ((*fileSize >> 16) << 16)); i++) {
-			if (write(fd, blck, 1) != 1) {
-				fprintf(stderr, "Write failed: %s\n",
-				    strerror(errno));
-				exit(1);
-			}
-		}
-		fsync(fd);
-		free(blck);
+		provision(fd, name, *fileSize);
 	} else {
 		/* Find the size of the file/device */
 		size = sb.st_size;
 		if (*fileSize == 0)
 			*fileSize = size;
+#ifdef BLKGETSIZE64
+		if (*fileSize == 0 && S_ISBLK(sb.st_mode) &&
+		    ioctl((*fds)[0], BLKGETSIZE64, &bytes) == 0)
+			*fileSize = bytes;
+#endif
 		/* We have to do it the other way... */
 		if (*fileSize == 0)
 			*fileSize = lseek((*fds)[0], 0, SEEK_END);
@@ -513,15 +4702,448 @@ openfile(int **fds, char *name, int64_t *fileSize, int threads, int access)
 		close(fd);
 }
 
+/*
+ * provision:
+ * Give a new temporary file its size.  The blocks are allocated in one
+ * go where the filesystem can, which also keeps them contiguous; then,
+ * unless -P alloc, written with zeros, so that first reads find real
+ * data rather than unwritten extents the filesystem answers from
+ * memory.  Without allocation support, -P alloc writes them anyway.
+ */
+#define PROVISION_CHUNK	(1024 * 1024)
+
+static void
+provision(int fd, const char *name, int64_t size)
+{
+	int64_t off;
+	ssize_t n;
+	char *blck;
+	int err;
+
+#if HAVE_FALLOCATE
+	err = fallocate(fd, 0, 0, size) == 0 ? 0 : errno;
+#elif HAVE_POSIX_FALLOCATE
+	err = posix_fallocate(fd, 0, size);
+#else
+	err = EOPNOTSUPP;
+#endif
+	if (err != 0 && err != EOPNOTSUPP && err != ENOSYS && err != EINVAL) {
+		fprintf(stderr, "Failed to allocate %" PRId64 " bytes for "
+		    "'%s': %s\n", size, name, strerror(err));
+		exit(1);
+	}
+	if (err != 0 && allocOnly)
+		fprintf(stderr, "Allocation not supported for '%s', writing "
+		    "it instead.\n", name);
+	if (err == 0 && allocOnly)
+		return;
+
+	if ((blck = calloc(1, PROVISION_CHUNK)) == NULL) {
+		fprintf(stderr, "malloc failed: %s\n", strerror(errno));
+		exit(1);
+	}
+	for (off = 0; off < size; off += n) {
+		n = size - off < PROVISION_CHUNK ? size - off : PROVISION_CHUNK;
+#if HAVE_PWRITE
+		n = pwrite(fd, blck, n, off);
+#else
+		n = write(fd, blck, n);
+#endif
+		if (n <= 0) {
+			fprintf(stderr, "Write failed: %s\n",
+			    n < 0 ? strerror(errno) : "no progress");
+			exit(1);
+		}
+	}
+	fsync(fd);
+	free(blck);
+}
+
+/*
+ * getAlignment:
+ * Find the offset and length alignment direct I/O needs on fd, or 0 if
+ * the file does not support direct I/O at all.  Falls back to the
+ * logical sector size of a block device, then to 512.
+ */
+static long
+getAlignment(int fd)
+{
+#if HAVE_STATX && defined(STATX_DIOALIGN)
+	struct statx stx;
+#endif
+#ifdef BLKSSZGET
+	struct stat sb;
+	int ssz;
+#endif
+
+#if HAVE_STATX && defined(STATX_DIOALIGN)
+	if (statx(fd, "", AT_EMPTY_PATH, STATX_DIOALIGN, &stx) == 0 &&
+	    (stx.stx_mask & STATX_DIOALIGN))
+		return stx.stx_dio_offset_align;
+#endif
+#ifdef BLKSSZGET
+	if (fstat(fd, &sb) == 0 && S_ISBLK(sb.st_mode) &&
+	    ioctl(fd, BLKSSZGET, &ssz) == 0 && ssz > 0)
+		return ssz;
+#endif
+	return 512;
+}
+
+/*
+ * getGeometry:
+ * The logical and physical sector sizes and optimal I/O size of a block
+ * device, where the system will tell us.
+ */
+static void
+getGeometry(struct target *t)
+{
+#if defined(BLKSSZGET) && defined(BLKPBSZGET)
+	struct stat sb;
+	unsigned int u;
+	int ssz;
+
+	if (fstat(t->fds[0], &sb) != 0 || !S_ISBLK(sb.st_mode))
+		return;
+	t->blkdev = 1;
+	if (ioctl(t->fds[0], BLKSSZGET, &ssz) == 0 && ssz > 0)
+		t->lsec = ssz;
+	if (ioctl(t->fds[0], BLKPBSZGET, &u) == 0)
+		t->psec = u;
+#ifdef BLKIOOPT
+	if (ioctl(t->fds[0], BLKIOOPT, &u) == 0)
+		t->optio = u;
+#endif
+#endif
+}
+
+/*
+ * discardRange:
+ * Discard the blocks of a request, with BLKDISCARD on a block device,
+ * or by punching a hole in a file.  Returns the bytes discarded, or -1.
+ */
+static ssize_t
+discardRange(struct ioreq *req)
+{
+#ifdef BLKDISCARD
+	uint64_t range[2];
+
+	if (targets[req->target].blkdev) {
+		range[0] = req->pos;
+		range[1] = req->len;
+		return ioctl(req->fd, BLKDISCARD, range) == 0 ? req->len : -1;
+	}
+#endif
+#if HAVE_FALLOCATE && defined(FALLOC_FL_PUNCH_HOLE)
+	return fallocate(req->fd, FALLOC_FL_PUNCH_HOLE | FALLOC_FL_KEEP_SIZE,
+	    req->pos, req->len) == 0 ? req->len : -1;
+#else
+	errno = EOPNOTSUPP;
+	return -1;
+#endif
+}
+
+/*
+ * printGeometry:
+ * The sectors of each target that is a block device.  Unformatted, a
+ * line of "geometry", the target, and logical sector, physical sector
+ * and optimal I/O sizes, 0 if not given.
+ */
+static void
+printGeometry(int unformatted)
+{
+	int t;
+
+	for (t = 0; t < ntargets; t++) {
+		if (targets[t].lsec == 0)
+			continue;
+		if (unformatted)
+			printf("geometry\t%s\t%ld\t%ld\t%ld\n",
+			    targets[t].name, targets[t].lsec, targets[t].psec,
+			    targets[t].optio);
+		else if (targets[t].optio > 0)
+			printf("'%s': %ld byte logical, %ld byte physical "
+			    "sectors, %ld byte optimal I/O\n", targets[t].name,
+			    targets[t].lsec, targets[t].psec,
+			    targets[t].optio);
+		else
+			printf("'%s': %ld byte logical, %ld byte physical "
+			    "sectors\n", targets[t].name, targets[t].lsec,
+			    targets[t].psec);
+	}
+}
+
+/*
+ * findDisks:
+ * The block devices under the targets, those themselves or those their
+ * filesystems are on, with statistics in /sys.  Several targets on one
+ * device share it.
+ */
+static void
+findDisks(void)
+{
+#ifdef major
+	char link[PATH_MAX], *p;
+	struct disk *d;
+	struct stat sb;
+	ssize_t n;
+	dev_t dev;
+	int t, i;
+
+	for (t = 0; t < ntargets; t++) {
+		if (fstat(targets[t].fds[0], &sb) != 0)
+			continue;
+		dev = S_ISBLK(sb.st_mode) ? sb.st_rdev : sb.st_dev;
+		for (i = 0; i < ndisks && disks[i].dev != dev; i++)
+			;
+		if (i < ndisks)
+			continue;
+		disks = realloc(disks, (ndisks + 1) * sizeof(*disks));
+		MYASSERT(disks != NULL, "malloc failed");
+		d = &disks[ndisks];
+		memset(d, 0, sizeof(*d));
+		d->dev = dev;
+		snprintf(d->path, sizeof(d->path), "/sys/dev/block/%u:%u",
+		    (unsigned)major(dev), (unsigned)minor(dev));
+		if ((n = readlink(d->path, link, sizeof(link) - 1)) <= 0)
+			continue;	/* not a block device, such as tmpfs */
+		link[n] = '\0';
+		p = strrchr(link, '/');
+		snprintf(d->name, sizeof(d->name), "%.*s",
+		    (int)sizeof(d->name) - 1, p != NULL ? p + 1 : link);
+		strcat(d->path, "/stat");
+		if (diskRead(d, d->start) == 0)
+			ndisks++;
+	}
+#endif
+}
+
+static int
+diskRead(const struct disk *d, uint64_t *v)
+{
+	FILE *fp;
+	int i;
+
+	if ((fp = fopen(d->path, "r")) == NULL)
+		return -1;
+	for (i = 0; i < DS_NSTAT && fscanf(fp, "%" SCNu64, &v[i]) == 1; i++)
+		;
+	fclose(fp);
+	return i == DS_NSTAT ? 0 : -1;
+}
+
+/*
+ * diskSample:
+ * Note the devices' statistics at the start of a run, or of a phase of
+ * a job, and at its end add what they did in between to the totals,
+ * unless the phase is not counted.
+ */
+static void
+diskSample(int end)
+{
+	uint64_t v[DS_NSTAT];
+	struct disk *d;
+	int64_t now;
+	int i;
+
+	now = nanotime();
+	for (d = disks; d < disks + ndisks; d++) {
+		if (diskRead(d, v) != 0)
+			continue;
+		if (!end) {
+			memcpy(d->start, v, sizeof(d->start));
+			d->startTime = now;
+			if (d->prevTime == 0) {
+				memcpy(d->prev, v, sizeof(d->prev));
+				d->prevTime = now;
+			}
+		} else if (curPhase == NULL || curPhase->report) {
+			for (i = 0; i < DS_NSTAT; i++)
+				d->sum[i] += v[i] - d->start[i];
+			d->secs += (now - d->startTime) / 1e9;
+		}
+	}
+}
+
+/*
+ * printDisks:
+ * What each device saw, as iostat(1) would put it: how busy it was, the
+ * mean number of I/Os queued or in flight, its reads and writes after
+ * merging, with those merged, their await (ms from queueing to done)
+ * and the service time, ms busy per I/O.  Unformatted, a line of
+ * "device", its name, reads, merged, await, writes, merged, await,
+ * %util, queue and service time.
+ */
+static void
+printDisks(int unformatted)
+{
+	uint64_t *s;
+	double ms, util, queue, svc, rdAwait, wrAwait;
+	struct disk *d;
+
+	for (d = disks; d < disks + ndisks; d++) {
+		s = d->sum;
+		if ((ms = d->secs * 1000) <= 0)
+			continue;
+		util = s[DS_BUSYMS] * 100 / ms;
+		if (util > 100)
+			util = 100;
+		queue = s[DS_QUEUEMS] / ms;
+		svc = s[DS_RD] + s[DS_WR] > 0 ?
+		    (double)s[DS_BUSYMS] / (s[DS_RD] + s[DS_WR]) : 0;
+		rdAwait = s[DS_RD] > 0 ? (double)s[DS_RDMS] / s[DS_RD] : 0;
+		wrAwait = s[DS_WR] > 0 ? (double)s[DS_WRMS] / s[DS_WR] : 0;
+		if (unformatted) {
+			printf("device\t%s\t%" PRIu64 "\t%" PRIu64 "\t%lf\t%"
+			    PRIu64 "\t%" PRIu64 "\t%lf\t%lf\t%lf\t%lf\n",
+			    d->name, s[DS_RD], s[DS_RDMERGE], rdAwait,
+			    s[DS_WR], s[DS_WRMERGE], wrAwait, util, queue,
+			    svc);
+			continue;
+		}
+		printf("Device %s: %.1lf%% busy, %.2lf queued on average, "
+		    "%.3lf ms service time\n", d->name, util, queue, svc);
+		printf("Device %s: %" PRIu64 " reads, %" PRIu64 " merged, "
+		    "%.3lf ms await; %" PRIu64 " writes, %" PRIu64 " merged, "
+		    "%.3lf ms await\n", d->name, s[DS_RD], s[DS_RDMERGE],
+		    rdAwait, s[DS_WR], s[DS_WRMERGE], wrAwait);
+	}
+}
+
+/*
+ * perfOpen:
+ * A counter of the CPU cycles of the calling thread, user and kernel,
+ * for -Y.  Returns -1, with errno set, if there is none.
+ */
+static int
+perfOpen(void)
+{
+#if HAVE_PERF_EVENT
+	struct perf_event_attr pe;
+
+	memset(&pe, 0, sizeof(pe));
+	pe.type = PERF_TYPE_HARDWARE;
+	pe.size = sizeof(pe);
+	pe.config = PERF_COUNT_HW_CPU_CYCLES;
+	pe.exclude_hv = 1;
+	return syscall(__NR_perf_event_open, &pe, 0, -1, -1, 0);
+#else
+	errno = ENOSYS;
+	return -1;
+#endif
+}
+
+/*
+ * cpuNow:
+ * The CPU used so far by the calling worker, or the whole process with
+ * any children it has waited for, and the cycles counted on fd, if not
+ * -1.  Without a getrusage(2) for a thread alone, a worker's time comes
+ * from its CPU clock, all counted as user time.
+ */
+static void
+cpuNow(struct cpuUse *c, int worker, int fd)
+{
+#if !defined(RUSAGE_WORKER) && defined(CLOCK_THREAD_CPUTIME_ID)
+	struct timespec ts;
+#endif
+	uint64_t v;
+
+	memset(c, 0, sizeof(*c));
+#ifdef RUSAGE_WORKER
+	if (worker)
+		usageAdd(c, RUSAGE_WORKER);
+#elif defined(CLOCK_THREAD_CPUTIME_ID)
+	if (worker && clock_gettime(CLOCK_THREAD_CPUTIME_ID, &ts) == 0)
+		c->user = ts.tv_sec * 1000000LL + ts.tv_nsec / 1000;
+#endif
+#if HAVE_GETRUSAGE
+	if (!worker) {
+		usageAdd(c, RUSAGE_SELF);
+#ifndef USE_PTHREADS
+		usageAdd(c, RUSAGE_CHILDREN);
+#endif
+	}
+#endif
+	if (fd >= 0 && read(fd, &v, sizeof(v)) == sizeof(v))
+		c->cycles = v;
+}
+
+#if HAVE_GETRUSAGE
+static void
+usageAdd(struct cpuUse *c, int who)
+{
+	struct rusage ru;
+
+	if (getrusage(who, &ru) != 0)
+		return;
+	c->user += ru.ru_utime.tv_sec * 1000000LL + ru.ru_utime.tv_usec;
+	c->sys += ru.ru_stime.tv_sec * 1000000LL + ru.ru_stime.tv_usec;
+	c->vcsw += ru.ru_nvcsw;
+	c->ivcsw += ru.ru_nivcsw;
+}
+#endif
+
+static void
+cpuAdd(struct cpuUse *c, const struct cpuUse *d, int sign)
+{
+	c->user += sign * d->user;
+	c->sys += sign * d->sys;
+	c->vcsw += sign * d->vcsw;
+	c->ivcsw += sign * d->ivcsw;
+	c->cycles += sign * d->cycles;
+}
+
+/*
+ * printCpu:
+ * What the I/O cost in CPU: the workers' user and system time, in
+ * cores over the run, per I/O and as IOs per core-second, and that of
+ * the whole process, which includes the status, log and steady state
+ * threads.  Unformatted, a line of "cpu", the workers' user and system
+ * seconds, the process's seconds, us per I/O, IOs per core-second,
+ * voluntary and involuntary context switches of the workers, and, with
+ * -Y, cycles per I/O.
+ */
+static void
+printCpu(int unformatted, double secs)
+{
+	double cpu, all, perIO, perCore;
+
+	cpu = (workCpu.user + workCpu.sys) / 1e6;
+	all = (procCpu.user + procCpu.sys) / 1e6;
+	perIO = numio > 0 ? cpu * 1e6 / numio : 0;
+	perCore = cpu > 0 ? numio / cpu : 0;
+	if (unformatted) {
+		printf("cpu\t%lf\t%lf\t%lf\t%lf\t%lf\t%" PRId64 "\t%"
+		    PRId64, workCpu.user / 1e6, workCpu.sys / 1e6, all, perIO,
+		    perCore, workCpu.vcsw, workCpu.ivcsw);
+		if (countCycles)
+			printf("\t%lf", numio > 0 ?
+			    (double)workCpu.cycles / numio : 0.0);
+		putchar('\n');
+		return;
+	}
+	printf("CPU %.3lf s user, %.3lf s sys in the workers, %.2lf cores: "
+	    "%.2lf us per I/O, %.0lf IOs per core-second\n",
+	    workCpu.user / 1e6, workCpu.sys / 1e6, secs > 0 ? cpu / secs : 0,
+	    perIO, perCore);
+	printf("CPU %.3lf s in all, %.2lf cores; %" PRId64 " voluntary and %"
+	    PRId64 " involuntary context switches in the workers\n", all,
+	    secs > 0 ? all / secs : 0, workCpu.vcsw, workCpu.ivcsw);
+	if (countCycles)
+		printf("%.0lf CPU cycles per I/O\n", numio > 0 ?
+		    (double)workCpu.cycles / numio : 0.0);
+}
+
 static void
 cleanup(int sig)
 {
-	flAborted = 1;
+	ATOMIC_STORE(&flAborted, 1);
 }
 
 static void
 usage()
 {
+	const struct ioengine *e;
+
 	fprintf(stderr,
 		"iohammer version " PACKAGE_VERSION ".\n"
 		    "Copyright Paul Ripke\n"
@@ -530,34 +5152,132 @@ usage()
 #else
 		"Built to use multiple processes.\n\n"
 #endif
-		"Usage: iohammer [-a | -r] [-iu] [-b size] "
+		"Usage: iohammer [-a | -r] [-diuVY] [-b size] "
 		    "[-c count] [-w write%%]\n"
-		"                [-t threads] [-s size] "
-		    "[-f file/dir/dev]\n\n"
+		"                [-e engine] [-q depth] [-L latency] "
+		    "[-p pattern] [-D discard%%]\n"
+		"                [-R rate] [-T time] [-t threads] [-s size] "
+		    "[-m rr | size]\n"
+		"                [-P alloc | write] [-S seed] "
+		    "[-o log [-I interval]] [-A align]\n"
+		"                [-C cpus] [-F flush] [-j job] [-x trace] "
+		    "[-X trace]\n"
+		"                [-Q sweep [-K target]] [-H heatmap] "
+		    "[-f file/dir/dev ...]\n\n"
 		"  -a          Write blocks of a repeating ASCII "
 		    "string\n"
 		"  -r          Write blocks of binary 'random' data\n"
-		"  -i          Ignore I/O errors and continue\n"
-		"  -b bytes    Set write blocksize\n"
+		"  -d          Direct I/O, bypassing the buffer cache "
+		    "(O_DIRECT)\n"
+		"  -i          Ignore I/O and verify errors and continue\n"
+		"  -V          Verify: stamp each block written with a "
+		    "header and CRC32C,\n"
+		"              and check reads of it against them\n"
+		"  -b bytes    Block size, or a weighted mix of sizes, "
+		    "e.g. 4k:70,64k:20,1m:10.\n"
+		"              The default is 512, or the physical sector "
+		    "of a device\n"
+		"  -A align    Start random I/Os at multiples of align "
+		    "bytes, not of their\n"
+		"              size, and :offset shifts every I/O by that "
+		    "many, e.g. 4k:512\n"
 		"  -c count    Number of blocks to read/write "
 		    "(zero for infinite)\n"
+		"  -T time     Stop after this long, e.g. 30s or 5m\n"
+		"  -R rate     Open loop: issue IOs/sec in total at fixed "
+		    "intervals, or\n"
+		"              poisson:rate for random arrivals. Latency "
+		    "is counted from\n"
+		"              when each I/O was due\n"
+		"  -e engine   I/O engine, see below\n"
+		"  -q depth    I/Os kept in flight per thread "
+		    "(asynchronous engines)\n"
+		"  -L latency  Latency of the sim engine: time, "
+		    "fixed:t, exp:mean,\n"
+		"              uniform:min:max or normal:mean:stddev\n"
 		"  -w write%%   Integer percentage of operations to be "
 		    "writes\n"
+		"  -D discard%% Integer percentage of operations to be "
+		    "discards: BLKDISCARD\n"
+		"              on devices, holes punched in files\n"
+		"  -F flush    Flush after writes, once those in flight "
+		    "are done: fsync,\n"
+		"              fdatasync or range (sync_file_range), after "
+		    "every write, or\n"
+		"              :n after every nth or :n%% after that share "
+		    "of them\n"
+		"  -p pattern  Access pattern: rand, seq, stride:bytes, "
+		    "zipf:theta or\n"
+		"              hot:io%%/space%%\n"
+		"  -S seed     Seed for the offsets and read/write mix, "
+		    "to repeat a run\n"
 		"  -t threads  Number of threads to do I/O\n"
+		"  -C cpus     Pin the threads in turn to a CPU list such "
+		    "as 0-3,8-11, or\n"
+		"              spread them over NUMA nodes: node or "
+		    "node:list\n"
 		"  -u          Unformatted output. Write tab-separated "
 		    "figures\n"
+		"  -o log      Write IOs/sec, MiB/s and latency for each "
+		    "interval to log,\n"
+		"              as JSON lines if it ends in .json or "
+		    ".jsonl, else CSV\n"
+		"  -I interval Interval for -o, default 1s\n"
+		"  -H heatmap  Write the I/Os and latency of each region "
+		    "of the targets to\n"
+		"              a CSV file; regions:file for other than 64 "
+		    "regions each\n"
+		"  -j job      Run the phases of a job file in turn, see "
+		    "iohammer(1)\n"
+		"  -Q sweep    Run with each number of threads in turn, "
+		    "e.g. 1-64 for the\n"
+		"              powers of two or 1,2,3,4, or queue depths "
+		    "given q:list\n"
+		"  -K target   Latency target for the knee of the sweep, "
+		    "e.g. p99:1ms\n"
+		"  -x trace    Replay a trace, from -X, text or blkparse "
+		    "output, at its\n"
+		"              original timing, or as fast as possible "
+		    "given fast:trace\n"
+		"  -X trace    Record the I/Os issued, as text if the "
+		    "name ends in .txt\n"
+		"  -Y          Count the CPU cycles of the I/O, with "
+		    "perf_event_open(2)\n"
 		"  -s size     Size of file/device to create/use\n"
 		"              Specify '0' to attempt to find the "
 		    "size of file/device\n"
+		"  -P prov     Temporary files are allocated but "
+		    "unwritten (alloc), or\n"
+		"              written with zeros (write, the default)\n"
 		"  -f file     Name of file (must exist), directory "
 		    "or device\n"
 		"              If directory, a temporary file is "
-		    "created\n\n"
+		    "created. Repeat for\n"
+		"              several targets\n"
+		"  -m spread   Spread I/Os over several targets: rr "
+		    "stripes them evenly,\n"
+		"              size in proportion to each target's "
+		    "size\n\n"
 		"Unformatted output, order is:\n"
 		"  size, threads, blocksize, write-pct, count, "
-		    "writes, seconds, rate\n\n"
+		    "writes, seconds, rate,\n"
+		"  then for reads and for writes, latency in ms: "
+		    "min, mean, p50, p90,\n"
+		"  p99, p99.9, p99.99, max, then with -V reads verified "
+		    "and failed,\n"
+		"  then with -F the flush count and flush latency "
+		    "as above, then with -D\n"
+		"  the discard count and discard latency as above.\n"
+		"  With several targets, a line for each follows, and "
+		    "with a mix of block\n"
+		"  sizes a line for each size: name or size, count, "
+		    "writes, rate, MiB/s,\n"
+		"  then latency as above. Lines named phase, level, "
+		    "knee and placement\n"
+		"  may follow, and with -v geometry, device and cpu, "
+		    "see iohammer(1)\n\n"
 		"Compiled defaults:\n"
-		"    iohammer -a -b 1s -c 0 -t 8 -w 0 -s 1m -f .\n\n"
+		"    iohammer -a -b 1s -c 0 -e sync -q 1 -t 8 -w 0 -s 1m -f .\n\n"
 		"  Numeric arguments take an optional "
 		    "letter multiplier:\n"
 		"    s:        Sectors (x 512)\n"
@@ -566,6 +5286,9 @@ usage()
 		"    g:        gibi (x 2^30)\n"
 		"    t:        tebi (x 2^40)\n"
 		"    p:        pebi (x 2^50)\n"
-		"    e:        exbi (x 2^60)\n"
+		"    e:        exbi (x 2^60)\n\n"
+		"I/O engines:\n"
 	);
+	for (e = engines; e->name != NULL; e++)
+		fprintf(stderr, "    %-9s %s\n", e->name, e->desc);
 }